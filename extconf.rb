@@ -24,5 +24,6 @@ printf("  \$LDFLAGS = %s\n", $LDFLAGS)
 printf("  \$libs = %s\n", $libs)
 
 if have_header('tcutil.h')
+  have_func('rb_thread_call_without_gvl', 'ruby/thread.h')
   create_makefile('tokyocabinet')
 end
@@ -378,6 +378,46 @@ def procmisc(path, rnum, opts, omode)
       end
     end
   end
+  usage = bdb.cacheusage
+  if usage && (usage["lnum"] < 1 || usage["lcnum"] < 1)
+    eprint(bdb, "cacheusage")
+    err = true
+  end
+  if usage && !bdb.adjcache(1.0, 1 << 26)
+    eprint(bdb, "adjcache")
+    err = true
+  end
+  pnum = 0
+  bdb.parallel_each(nil, nil, 4) do |key, value|
+    pnum += 1
+  end
+  if pnum != bdb.rnum
+    eprint(bdb, "parallel_each")
+    err = true
+  end
+  pnum = bdb.rnum
+  recs = bdb.pop(2)
+  rec = bdb.shift
+  if recs.size != 2 || !rec || bdb.rnum != pnum - 3
+    eprint(bdb, "shift/pop")
+    err = true
+  end
+  recs.push(rec)
+  recs.each do |key, value|
+    bdb.put(key, value)
+  end
+  for i in 1..10
+    bdb.put("range:" + i.to_s, i.to_s)
+  end
+  if bdb.out_range("range:", true, "range:~", false, true) != 10
+    eprint(bdb, "out_range")
+    err = true
+  end
+  keys = [ sprintf("%08d", rnum), sprintf("%08d", 1), "[nokey]", sprintf("%08d", rnum) ]
+  if bdb.mget_sorted(keys) != keys.map { |key| bdb.get(key) }
+    eprint(bdb, "mget_sorted")
+    err = true
+  end
   printf("removing:\n")
   for i in 1..rnum
     buf = sprintf("%08d", i)
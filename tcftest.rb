@@ -341,6 +341,43 @@ def procmisc(path, rnum, omode)
       end
     end
   end
+  if !fdb.put_i64(rnum + 1, -(1 << 40)) || fdb.get_i64(rnum + 1) != -(1 << 40) ||
+      !fdb.put_f64(rnum + 2, 1.5) || fdb.get_f64(rnum + 2) != 1.5 || !fdb.get(1)
+    eprint(fdb, "put_i64/put_f64")
+    err = true
+  end
+  fdb.out(rnum + 1)
+  fdb.out(rnum + 2)
+  for i in 1..4
+    fdb.put_i64(rnum + i, i)
+  end
+  interval = sprintf("[%d,%d]", rnum + 1, rnum + 4)
+  if fdb.sum(interval) != 10 || fdb.min(interval) != 1 || fdb.max(interval) != 4 ||
+      fdb.mean(interval) != 2.5 || fdb.histogram(1, 4, 3, interval) != [ 1, 1, 2 ] ||
+      fdb.sum(sprintf("[%d,999999999999]", rnum + 1)) != 10
+    eprint(fdb, "sum/min/max/mean/histogram")
+    err = true
+  end
+  for i in 1..4
+    fdb.out(rnum + i)
+  end
+  id = fdb.append_batch([ "a", "b", "c" ])
+  if !id || fdb.get(id) != "a" || fdb.get(id + 2) != "c"
+    eprint(fdb, "append_batch")
+    err = true
+  end
+  for i in 0..2
+    fdb.out(id + i) if id
+  end
+  if fdb.append_batch(Array::new(rnum * 4 + 100, "x")) || fdb.get(rnum + 1)
+    eprint(fdb, "append_batch")
+    err = true
+  end
+  data, bits = fdb.read_range(1, 3)
+  if data.size != 30 || bits.unpack("C")[0] != 7
+    eprint(fdb, "read_range")
+    err = true
+  end
   printf("removing:\n")
   for i in 1..rnum
     buf = sprintf("%08d", i)
@@ -423,6 +460,71 @@ def procmisc(path, rnum, omode)
     err = true
   end
   File::unlink(npath)
+  tsdb = FDB::new
+  tsdb.tune(16, 1024 * 16)
+  if !tsdb.open(npath, FDB::OWRITER | FDB::OCREAT | FDB::OTRUNC)
+    eprint(tsdb, "open")
+    err = true
+  end
+  ts = FDBTS::new(tsdb, 10, 8)
+  begin
+    FDBTS::new(fdb, 10)
+    eprint(fdb, "FDBTS::new")
+    err = true
+  rescue ArgumentError
+  end
+  for i in 0...12
+    ts.put(i * 10, i)
+  end
+  if ts.get(0) || ts.get(110) != 11.0 ||
+      ts.fetch(0, 119, 20, FDBTS::AGGMAX) != [ [40, 5.0], [60, 7.0], [80, 9.0], [100, 11.0] ]
+    eprint(tsdb, "FDBTS")
+    err = true
+  end
+  if !tsdb.close
+    eprint(tsdb, "close")
+    err = true
+  end
+  File::unlink(npath)
+  bmdbs = []
+  bms = []
+  for i in 0..1
+    bmdbs[i] = FDB::new
+    bmdbs[i].tune(8, 1024 * 8)
+    if !bmdbs[i].open(npath + i.to_s, FDB::OWRITER | FDB::OCREAT | FDB::OTRUNC)
+      eprint(bmdbs[i], "open")
+      err = true
+    end
+    bms[i] = FDBBM::new(bmdbs[i])
+  end
+  [ 1, 63, 64, 200 ].each { |num| bms[0].set(num) }
+  [ 63, 200, 300 ].each { |num| bms[1].set(num) }
+  bms[0].clear(1)
+  if !bms[0].test(64) || bms[0].test(1) || bms[0].count != 3 || bms[0].count(64, 199) != 1 ||
+      !bms[0].and(bms[1]) || bms[0].count != 2 || !bms[0].or(bms[1]) || bms[0].count != 3 ||
+      !bms[0].andnot(bms[1]) || bms[0].count != 0
+    eprint(bmdbs[0], "FDBBM")
+    err = true
+  end
+  begin
+    FDBBM::new(FDB::new)
+    eprint(fdb, "FDBBM::new")
+    err = true
+  rescue ArgumentError
+  end
+  begin
+    bms[0].and(fdb)
+    eprint(fdb, "FDBBM::and")
+    err = true
+  rescue ArgumentError
+  end
+  for i in 0..1
+    if !bmdbs[i].close
+      eprint(bmdbs[i], "close")
+      err = true
+    end
+    File::unlink(npath + i.to_s)
+  end
   if !fdb.vanish
     eprint(fdb, "vanish")
     err = true
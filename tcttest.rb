@@ -503,6 +503,14 @@ def procmisc(path, rnum, opts, omode)
     eprint(tdb, "optimize")
     err = true
   end
+  if BDB::new.cacheusage && !tdb.adjcache(1.0, 1 << 26)
+    eprint(tdb, "adjcache")
+    err = true
+  end
+  if tdb.adjcache(1.0, 1)
+    eprint(tdb, "adjcache")
+    err = true
+  end
   npath = path + "-tmp"
   if !tdb.copy(npath)
     eprint(tdb, "copy")
@@ -571,6 +579,241 @@ def procmisc(path, rnum, opts, omode)
     eprint(tdb, "(validation)")
     err = true
   end
+  tdb.put("proj", { "a" => "1", "b" => "2", "c" => "3" })
+  if tdb.get("proj", [ "a", "c", "z" ]) != { "a" => "1", "c" => "3" } || tdb.getcol("proj", "b") != "2"
+    eprint(tdb, "get/getcol")
+    err = true
+  end
+  tdb.put("typed", { "i" => -3, "f" => 1.5, "b" => true, "s" => "x" })
+  tdb.setschema({ "i" => TDB::CTINT, "f" => TDB::CTFLOAT, "b" => TDB::CTBOOL })
+  if tdb.get("typed") != { "i" => -3, "f" => 1.5, "b" => true, "s" => "x" } ||
+      tdb.getcol("typed", "i") != -3 || tdb.getcol("typed", "s") != "x"
+    eprint(tdb, "setschema")
+    err = true
+  end
+  tscls = Struct::new(:i, :s)
+  tdb.setschema({ "i" => TDB::CTINT }, tscls)
+  if tdb.get("typed") != tscls::new(-3, "x")
+    eprint(tdb, "setschema")
+    err = true
+  end
+  begin
+    tdb.setschema({ "i" => TDB::CTINT }, String)
+    eprint(tdb, "setschema")
+    err = true
+  rescue ArgumentError
+  end
+  tdb.setschema(nil)
+  tdb.put("typed", { "f" => 0.1 })
+  if tdb.get("typed") != { "f" => "0.1" }
+    eprint(tdb, "put")
+    err = true
+  end
+  tdb.out("typed")
+  tdb.put("fts", { "body" => "the quick brown fox", "tags" => "red green blue" })
+  if !tdb.setindex("body", TDB::ITQGRAM) || !tdb.setindex("tags", TDB::ITTOKEN)
+    eprint(tdb, "setindex")
+    err = true
+  end
+  qry = TDBQRY::new(tdb)
+  qry.addcond("body", TDBQRY::QCFTSPH, "quick brown")
+  qry.addcond("tags", TDBQRY::QCFTSAND, "green red")
+  oqry = TDBQRY::new(tdb)
+  oqry.addcond("body", TDBQRY::QCFTSEX, "quick && slow")
+  if qry.search != [ "fts" ] || oqry.search != []
+    eprint(tdb, "qry::search")
+    err = true
+  end
+  if !tdb.bulkbegin || tdb.bulkbegin
+    eprint(tdb, "bulkbegin")
+    err = true
+  end
+  tdb.put("fts2", { "body" => "a quick brown dog", "tags" => "red" })
+  oqry = TDBQRY::new(tdb)
+  oqry.addcond("body", TDBQRY::QCFTSPH, "brown dog")
+  if !tdb.bulkend || tdb.bulkend || qry.search != [ "fts" ] || oqry.search != [ "fts2" ]
+    eprint(tdb, "bulkend")
+    err = true
+  end
+  npath = path + "-tmp"
+  btdb = TDB::new
+  if !btdb.open(npath, TDB::OWRITER | TDB::OCREAT | TDB::OTRUNC) ||
+      !btdb.setindex("a", TDB::ITLEXICAL) || !btdb.bulkbegin || !File::exist?(npath + ".bulk") ||
+      !btdb.close || File::exist?(npath + ".bulk") ||
+      !btdb.open(npath, TDB::OWRITER) || btdb.setindex("a", TDB::ITLEXICAL | TDB::ITKEEP) ||
+      !btdb.close
+    eprint(btdb, "bulkbegin/close")
+    err = true
+  end
+  Dir.glob("#{npath}.idx.*").each do |tpath|
+    File.unlink(tpath)
+  end
+  File.unlink(npath)
+  tdb.setindex("body", TDB::ITVOID)
+  tdb.setindex("tags", TDB::ITVOID)
+  tdb.out("fts")
+  tdb.out("fts2")
+  qry = TDBQRY::new(tdb)
+  qry.addcond("a", TDBQRY::QCSTREQ, "1")
+  if qry.searchrows([ "b" ]) != [ [ "proj", { "b" => "2" } ] ]
+    eprint(tdb, "qry::searchrows")
+    err = true
+  end
+  qry = TDBQRY::new(tdb)
+  qry.addcond("a", TDBQRY::QCSTREQ, :a)
+  qry.addcond("b", TDBQRY::QCNUMGE, 2)
+  if qry.execute(:a => "1") != [ "proj" ] || qry.execute(:a => "2") != []
+    eprint(tdb, "qry::execute")
+    err = true
+  end
+  begin
+    qry.searchout
+    eprint(tdb, "qry::searchout")
+    err = true
+  rescue ArgumentError
+  end
+  if !tdb.get("proj")
+    eprint(tdb, "qry::searchout")
+    err = true
+  end
+  qry = TDBQRY::new(tdb)
+  qry.addcond("a", TDBQRY::QCSTREQ, "1")
+  oqry = TDBQRY::new(tdb)
+  oqry.addcond("c", TDBQRY::QCSTREQ, "3")
+  if qry.metasearch([ oqry ], TDBQRY::MSUNION) != [ "proj" ] ||
+      qry.metasearch([ oqry ], TDBQRY::MSDIFF) != []
+    eprint(tdb, "qry::metasearch")
+    err = true
+  end
+  [ "x", TDBQRY::new(TDB::new) ].each do |other|
+    begin
+      qry.metasearch([ other ])
+      eprint(tdb, "qry::metasearch")
+      err = true
+    rescue ArgumentError
+    end
+  end
+  if qry.count != 1 || !qry.exists? || oqry.count != 1
+    eprint(tdb, "qry::count")
+    err = true
+  end
+  for i in 1..6
+    tdb.put("agg" + i.to_s, { "grp" => (i % 2 == 0 ? "even" : "odd"), "amt" => i.to_s })
+  end
+  qry = TDBQRY::new(tdb)
+  qry.addcond("grp", TDBQRY::QCSTROREQ, "even odd")
+  if qry.aggregate("grp", [ [ TDBQRY::AGGCOUNT, nil ], [ TDBQRY::AGGSUM, "amt" ],
+                            [ TDBQRY::AGGMIN, "amt" ], [ TDBQRY::AGGAVG, "amt" ] ]) !=
+      { "even" => [ 3, 12.0, 2.0, 4.0 ], "odd" => [ 3, 9.0, 1.0, 3.0 ] } ||
+      qry.aggregate(nil, [ [ TDBQRY::AGGMAX, "amt" ], [ TDBQRY::AGGMAX, "none" ] ]) != { nil => [ 6.0, nil ] }
+    eprint(tdb, "qry::aggregate")
+    err = true
+  end
+  qry = TDBQRY::new(tdb)
+  qry.addcond("grp", TDBQRY::QCSTREQ, "odd")
+  rv = qry.proc(true) do |pkey, row|
+    row["amt"] = (row["amt"].to_i * 10).to_s
+    row.delete("grp") if pkey == "agg1"
+    row["grp"] = "odd" if pkey == "agg3"
+    row.changed? ? TDBQRY::QPPUT : 0
+  end
+  if !rv || tdb.get("agg1") != { "amt" => "10" } || tdb.get("agg3") != { "grp" => "odd", "amt" => "30" }
+    eprint(tdb, "qry::proc")
+    err = true
+  end
+  qry = TDBQRY::new(tdb)
+  qry.addcond("grp", TDBQRY::QCSTREQ, "even")
+  if qry.update([ [ TDBQRY::QUADD, "amt", 5 ], [ TDBQRY::QUSET, "flag", "on" ],
+                  [ TDBQRY::QUCAT, "flag", "!" ], [ TDBQRY::QUDEL, "grp", nil ] ]) != 3 ||
+      tdb.get("agg2") != { "amt" => "7", "flag" => "on!" } || qry.update([]) != 0
+    eprint(tdb, "qry::update")
+    err = true
+  end
+  qry = TDBQRY::new(tdb)
+  qry.addcond("", TDBQRY::QCSTREQ, "agg2")
+  if !tdb.tranbegin || qry.update([ [ TDBQRY::QUSET, "flag", "off" ] ]) != 1 ||
+      !tdb.tranabort || tdb.get("agg2")["flag"] != "on!"
+    eprint(tdb, "qry::update")
+    err = true
+  end
+  if qry.update([ [ TDBQRY::QUADD, "amt", (1 << 63) - 1 ] ]) != -1 || tdb.get("agg2")["amt"] != "7"
+    eprint(tdb, "qry::update")
+    err = true
+  end
+  qry = TDBQRY::new(tdb)
+  qry.addcond("amt", TDBQRY::QCNUMGE, 0)
+  if qry.top(2, "amt", TDBQRY::QONUMDESC) != [ "agg5", "agg3" ] ||
+      qry.top(3, "amt", TDBQRY::QOSTRASC) != [ "agg1", "agg6", "agg3" ]
+    eprint(tdb, "qry::top")
+    err = true
+  end
+  tdb.setindex("amt", TDB::ITDECIMAL)
+  if qry.top(2, "amt", TDBQRY::QONUMASC) != [ "agg2", "agg4" ]
+    eprint(tdb, "qry::top")
+    err = true
+  end
+  qry = TDBQRY::new(tdb)
+  qry.addcond("amt", TDBQRY::QCNUMBT, "8 30")
+  qry.setorder("amt", TDBQRY::QONUMASC)
+  if qry.searchrows([ "", "amt" ]) != [ [ "agg4", { "amt" => "9" } ], [ "agg1", { "amt" => "10" } ],
+                                        [ "agg6", { "amt" => "11" } ], [ "agg3", { "amt" => "30" } ] ] ||
+      qry.searchrows([ "amt", "grp" ]).collect { |row| row[1]["amt"] } != [ "9", "10", "11", "30" ] ||
+      qry.search != [ "agg4", "agg1", "agg6", "agg3" ]
+    eprint(tdb, "qry::searchrows")
+    err = true
+  end
+  qry = TDBQRY::new(tdb)
+  qry.addcond("", TDBQRY::QCSTRBW, "agg")
+  rows = qry.searchrows([ "amt" ])
+  if rows.length != 6 || rows.find { |row| row[1] != tdb.get(row[0], [ "amt" ]) }
+    eprint(tdb, "qry::searchrows")
+    err = true
+  end
+  tdb.setindex("amt", TDB::ITVOID)
+  for i in 1..6
+    tdb.out("agg" + i.to_s)
+  end
+  npath = path + "-tmp"
+  shdbs = []
+  for i in 0..2
+    shdbs[i] = TDB::new
+    if !shdbs[i].open(npath + i.to_s, TDB::OWRITER | TDB::OCREAT | TDB::OTRUNC)
+      eprint(shdbs[i], "open")
+      err = true
+    end
+  end
+  shard = TDBSHARD::new(shdbs)
+  for i in 1..20
+    shard.put(i.to_s, { "num" => i.to_s, "odd" => (i % 2).to_s })
+  end
+  qry = TDBQRY::new(shdbs[0])
+  qry.addcond("odd", TDBQRY::QCSTREQ, :odd)
+  qry.setorder("num", TDBQRY::QONUMDESC)
+  qry.setlimit(3, 1)
+  if shard.rnum != 20 || shard.get("7") != { "num" => "7", "odd" => "1" } ||
+      shdbs[shard.shard("7")].get("7") == nil || !shard.out("7") || shard.get("7") ||
+      shard.search(qry, :odd => "1") != [ "17", "15", "13" ] ||
+      shard.search(qry, :odd => "0") != [ "18", "16", "14" ]
+    eprint(tdb, "TDBSHARD")
+    err = true
+  end
+  qry.setlimit(nil, 8)
+  if shard.search(qry, :odd => "1") != [ "1" ]
+    eprint(tdb, "TDBSHARD")
+    err = true
+  end
+  qry.setlimit(-1)
+  if shard.search(qry, :odd => "1").length != 9
+    eprint(tdb, "TDBSHARD")
+    err = true
+  end
+  for i in 0..2
+    if !shdbs[i].close
+      eprint(shdbs[i], "close")
+      err = true
+    end
+    File::unlink(npath + i.to_s)
+  end
   if !tdb.vanish
     eprint(tdb, "vanish")
     err = true
@@ -423,6 +423,21 @@ module TokyoCabinet
     def setxmsiz(xmsiz)
       # (native code)
     end
+    # Get the usage of the page caches.%%
+    # The return value is a hash of the usage: "lcnum" for the maximum number of cached leaf nodes, "ncnum" for the maximum number of cached non-leaf nodes, "lcache" for the number of leaf nodes in the cache, "ncache" for the number of non-leaf nodes in the cache, "lnum" for the number of all leaf nodes, and "nnum" for the number of all non-leaf nodes.  If the library is not a version whose internal layout is known to the binding, `nil' is returned.%%
+    # The ratio of "lcache" to "lnum" is the ratio of the leaf pages resident in memory.  The library does not count cache hits and misses, so they are not reported.%%
+    def cacheusage()
+      # (native code)
+    end
+    # Adjust the caching parameters of the opened database.%%
+    # `<i>ratio</i>' specifies the target ratio of pages resident in the caches to all pages.  1.0 means that all pages are cached.%%
+    # `<i>limit</i>' specifies the size limit of memory in bytes for the caches of all opened database objects in the process.  If it is not defined or not more than 0, no limit is specified.%%
+    # If successful, the return value is true, else, it is false.%%
+    # If the limit cannot hold the minimum caches, the parameters are not changed and false is returned.  False is also returned if the library is not a version whose internal layout is known to the binding.  In that case, use `setcache' before the database is opened.%%
+    # The size of each page is estimated by the file size.  Non-leaf nodes are given priority over leaf nodes within the limit.  The caches are not adjusted automatically, so this method should be called periodically while the database is opened to follow the growth of the database.%%
+    def adjcache(ratio, limit)
+      # (native code)
+    end
     # Open a database file.%%
     # `<i>path</i>' specifies the path of the database file.%%
     # `<i>omode</i>' specifies the connection mode: `TokyoCabinet::BDB::OWRITER' as a writer, `TokyoCabinet::BDB::OREADER' as a reader.  If the mode is `TokyoCabinet::BDB::OWRITER', the following may be added by bitwise-or: `TokyoCabinet::BDB::OCREAT', which means it creates a new database if not exist, `TokyoCabinet::BDB::OTRUNC', which means it creates a new database regardless if one exists, `TokyoCabinet::BDB::OTSYNC', which means every transaction synchronizes updated contents with the device.  Both of `TokyoCabinet::BDB::OREADER' and `TokyoCabinet::BDB::OWRITER' can be added to by bitwise-or: `TokyoCabinet::BDB::ONOLCK', which means it opens the database file without file locking, or `TokyoCabinet::BDB::OLCKNB', which means locking is performed without blocking.  If it is not defined, `TokyoCabinet::BDB::OREADER' is specified.%%
@@ -503,6 +518,13 @@ module TokyoCabinet
     def getlist(key)
       # (native code)
     end
+    # Retrieve records in a batch.%%
+    # `<i>keys</i>' specifies a list object of the keys.%%
+    # The return value is a list object of the values of the corresponding records in the same order as the keys.  `nil' is placed for keys with no corresponding record.%%
+    # The keys are sorted by the comparison function and served with one cursor moving forward, so clustered keys are found without searching from the root each time.  If duplication of keys is allowed, the value of the first record is retrieved.%%
+    def mget_sorted(keys)
+      # (native code)
+    end
     # Get the number of records corresponding a key.%%
     # `<i>key</i>' specifies the key.%%
     # If successful, the return value is the number of the corresponding records, else, it is 0.%%
@@ -526,6 +548,17 @@ module TokyoCabinet
     def range(bkey, binc, ekey, einc, max)
       # (native code)
     end
+    # Remove ranged records.%%
+    # `<i>bkey</i>' specifies the key of the beginning border.  If it is not defined, the first record is specified.%%
+    # `<i>binc</i>' specifies whether the beginning border is inclusive or not.  If it is not defined, false is specified.%%
+    # `<i>ekey</i>' specifies the key of the ending border.  If it is not defined, the last record is specified.%%
+    # `<i>einc</i>' specifies whether the ending border is inclusive or not.  If it is not defined, false is specified.%%
+    # `<i>tran</i>' specifies whether the removal is done in a transaction or not.  If it is not defined, false is specified.%%
+    # If successful, the return value is the number of removed records, else, it is `nil'.%%
+    # The records are removed with a single cursor walk, so the cost is bounded by the leaves touched rather than by one search per key.  If the removal is done in a transaction and fails or the comparison function raises an exception, the transaction is aborted and no record is removed.%%
+    def out_range(bkey, binc, ekey, einc, tran)
+      # (native code)
+    end
     # Get forward matching keys.%%
     # `<i>prefix</i>' specifies the prefix of the corresponding keys.%%
     # `<i>max</i>' specifies the maximum number of keys to be fetched.  If it is not defined or negative, no limit is specified.%%
@@ -533,6 +566,31 @@ module TokyoCabinet
     def fwmkeys(prefix, max)
       # (native code)
     end
+    # Iterate a key range with parallel partitioned scans.%%
+    # `<i>bkey</i>' specifies the key of the beginning border, which is inclusive.  If it is not defined, the first record is specified.%%
+    # `<i>ekey</i>' specifies the key of the ending border, which is inclusive.  If it is not defined, the last record is specified.%%
+    # `<i>tnum</i>' specifies the number of partitions scanned concurrently.  If it is not defined, 1 is specified.%%
+    # The iterator block is called with the key and the value of each record.  The return value is the last result of the block.%%
+    # The range is split at existing keys and each partition is read by its own thread without the global interpreter lock.  Records are yielded in key order within each partition but the order across partitions is not guaranteed.  Partitioning is not used if the comparison function is a Ruby procedure.%%
+    def parallel_each(bkey, ekey, tnum)
+      # (native code)
+    end
+    # Remove and retrieve the first records.%%
+    # `<i>num</i>' specifies the maximum number of records to be removed.  If it is not defined, one record is removed and returned by itself.%%
+    # `<i>timeout</i>' specifies the number of seconds to wait for a record when the database is empty.  If it is negative, it waits forever.  If it is not defined, it does not wait.%%
+    # If `<i>num</i>' is not defined, the return value is a pair of the key and the value of the removed record or `nil' if no record was removed.  Otherwise, the return value is a list object of such pairs.%%
+    # Each record is read and removed while the global interpreter lock is held, so no other Ruby thread of this process can take the same record.  The database lock is not held across the read and the removal, so the operation is not atomic against other processes or native threads sharing the handle.  Waiting threads are woken when a record is stored by `put', `putkeep', `putcat', `putdup', or `putlist'.%%
+    def shift(num, timeout)
+      # (native code)
+    end
+    # Remove and retrieve the last records.%%
+    # `<i>num</i>' specifies the maximum number of records to be removed.  If it is not defined, one record is removed and returned by itself.%%
+    # `<i>timeout</i>' specifies the number of seconds to wait for a record when the database is empty.  If it is negative, it waits forever.  If it is not defined, it does not wait.%%
+    # If `<i>num</i>' is not defined, the return value is a pair of the key and the value of the removed record or `nil' if no record was removed.  Otherwise, the return value is a list object of such pairs.%%
+    # This method behaves like `shift' except that records are taken from the end.%%
+    def pop(num, timeout)
+      # (native code)
+    end
     # Add an integer to a record.%%
     # `<i>key</i>' specifies the key.%%
     # `<i>num</i>' specifies the additional value.%%
@@ -743,6 +801,10 @@ module TokyoCabinet
     ONOLCK = 1 << 4
     # open mode: lock without blocking
     OLCKNB = 1 << 5
+    # numeric type: 64-bit integer
+    NUMI64 = 0
+    # numeric type: 64-bit real number
+    NUMF64 = 1
     # Create a fixed-length database object.%%
     # The return value is the new fixed-length database object.%%
     def initialize()
@@ -781,7 +843,7 @@ module TokyoCabinet
       # (native code)
     end
     # Store a record.%%
-    # `<i>key</i>' specifies the key.  It should be more than 0.  If it is "min", the minimum ID number of existing records is specified.  If it is "prev", the number less by one than the minimum ID number of existing records is specified.  If it is "max", the maximum ID number of existing records is specified.  If it is "next", the number greater by one than the maximum ID number of existing records is specified.%%
+    # `<i>key</i>' specifies the key.  It should be more than 0.  If it is "min", the minimum ID number of existing records is specified.  If it is "prev", the number less by one than the minimum ID number of existing records is specified.  If it is "max", the maximum ID number of existing records is specified.  If it is "next", the number greater by one than the maximum ID number of existing records is specified.  If it is an integer, it is used as the ID number without conversion.%%
     # `<i>value</i>' specifies the value.%%
     # If successful, the return value is true, else, it is false.%%
     # If a record with the same key exists in the database, it is overwritten.%%
@@ -804,6 +866,14 @@ module TokyoCabinet
     def putcat(key, value)
       # (native code)
     end
+    # Store records with new ID numbers.%%
+    # `<i>values</i>' specifies a list object of the values.%%
+    # `<i>sync</i>' specifies whether updated contents are synchronized with the device after storing.  If it is not defined, false is specified.%%
+    # If successful, the return value is the ID number of the first stored record, else, it is `nil'.%%
+    # The values are stored with consecutive ID numbers starting from the one greater by one than the maximum ID number of existing records, in one call.  If the last ID number would exceed the limit of the database, no record is stored.  If an error occurs in the middle, the records stored before it are kept.%%
+    def append_batch(values, sync)
+      # (native code)
+    end
     # Remove a record.%%
     # `<i>key</i>' specifies the key.  It should be more than 0.  If it is `FDBIDMIN', the minimum ID number of existing records is specified.  If it is `FDBIDMAX', the maximum ID number of existing records is specified.%%
     # If successful, the return value is true, else, it is false.%%
@@ -816,6 +886,34 @@ module TokyoCabinet
     def get(key)
       # (native code)
     end
+    # Store an integer record.%%
+    # `<i>key</i>' specifies the key.  It should be more than 0.  If it is an integer, it is used as the ID number without conversion.%%
+    # `<i>num</i>' specifies the integer value.%%
+    # If successful, the return value is true, else, it is false.%%
+    # The value is stored as a 64-bit integer in the native byte order, so the width of the database should be 8 or more.%%
+    def put_i64(key, num)
+      # (native code)
+    end
+    # Retrieve an integer record.%%
+    # `<i>key</i>' specifies the key.  It should be more than 0.  If it is an integer, it is used as the ID number without conversion.%%
+    # If successful, the return value is the integer value of the corresponding record.  `nil' is returned if no record corresponds or the value is not 8 bytes long.%%
+    def get_i64(key)
+      # (native code)
+    end
+    # Store a real number record.%%
+    # `<i>key</i>' specifies the key.  It should be more than 0.  If it is an integer, it is used as the ID number without conversion.%%
+    # `<i>num</i>' specifies the real number value.%%
+    # If successful, the return value is true, else, it is false.%%
+    # The value is stored as a double in the native format, which is the same as the one used by `adddouble'.%%
+    def put_f64(key, num)
+      # (native code)
+    end
+    # Retrieve a real number record.%%
+    # `<i>key</i>' specifies the key.  It should be more than 0.  If it is an integer, it is used as the ID number without conversion.%%
+    # If successful, the return value is the real number value of the corresponding record.  `nil' is returned if no record corresponds or the value is not 8 bytes long.%%
+    def get_f64(key)
+      # (native code)
+    end
     # Get the size of the value of a record.%%
     # `<i>key</i>' specifies the key.  It should be more than 0.  If it is `FDBIDMIN', the minimum ID number of existing records is specified.  If it is `FDBIDMAX', the maximum ID number of existing records is specified.%%
     # If successful, the return value is the size of the value of the corresponding record, else, it is -1.%%
@@ -841,6 +939,54 @@ module TokyoCabinet
     def range(interval, max)
       # (native code)
     end
+    # Read records of a range of ID numbers into one buffer.%%
+    # `<i>lower</i>' specifies the lower limit of the range.  If it is "min", the minimum ID is specified.%%
+    # `<i>upper</i>' specifies the upper limit of the range.  If it is "max", the maximum ID is specified.%%
+    # `<i>buf</i>' specifies a string object to be filled and reused.  If it is not defined, a new string object is created.%%
+    # The return value is a list object of the data and the bitmap.  The data contains the values of the records back to back, each padded with zero bytes to the width of the database.  The bitmap contains one bit per ID, starting from the least significant bit of the first byte, and the bit is set if the record exists.%%
+    # No object is created for each record, so the result can be passed to `unpack' directly.%%
+    def read_range(lower, upper, buf)
+      # (native code)
+    end
+    # Get the summation of numeric records.%%
+    # `<i>interval</i>' specifies the interval of the ID numbers.  It is expressed as "[lower,upper]" like the one of `range'.  If it is not defined, all records are specified.  The upper limit is cut down to the largest ID number in the database.%%
+    # `<i>type</i>' specifies the numeric type of the records: `TokyoCabinet::FDB::NUMI64' for 64-bit integers, `TokyoCabinet::FDB::NUMF64' for real numbers.  If it is not defined, `TokyoCabinet::FDB::NUMI64' is specified.%%
+    # The return value is the summation.  Records whose size is not 8 bytes are ignored.%%
+    # The records are aggregated in C without the global interpreter lock and no object is created for each record.%%
+    def sum(interval, type)
+      # (native code)
+    end
+    # Get the minimum of numeric records.%%
+    # `<i>interval</i>' specifies the interval of the ID numbers.  If it is not defined, all records are specified.%%
+    # `<i>type</i>' specifies the numeric type of the records.  If it is not defined, `TokyoCabinet::FDB::NUMI64' is specified.%%
+    # The return value is the minimum or `nil' if no record corresponds.%%
+    def min(interval, type)
+      # (native code)
+    end
+    # Get the maximum of numeric records.%%
+    # `<i>interval</i>' specifies the interval of the ID numbers.  If it is not defined, all records are specified.%%
+    # `<i>type</i>' specifies the numeric type of the records.  If it is not defined, `TokyoCabinet::FDB::NUMI64' is specified.%%
+    # The return value is the maximum or `nil' if no record corresponds.%%
+    def max(interval, type)
+      # (native code)
+    end
+    # Get the arithmetic mean of numeric records.%%
+    # `<i>interval</i>' specifies the interval of the ID numbers.  If it is not defined, all records are specified.%%
+    # `<i>type</i>' specifies the numeric type of the records.  If it is not defined, `TokyoCabinet::FDB::NUMI64' is specified.%%
+    # The return value is the mean as a real number or `nil' if no record corresponds.%%
+    def mean(interval, type)
+      # (native code)
+    end
+    # Get the histogram of numeric records.%%
+    # `<i>lower</i>' specifies the lower limit of the values.%%
+    # `<i>upper</i>' specifies the upper limit of the values.%%
+    # `<i>buckets</i>' specifies the number of buckets of equal width.%%
+    # `<i>interval</i>' specifies the interval of the ID numbers.  If it is not defined, all records are specified.%%
+    # `<i>type</i>' specifies the numeric type of the records.  If it is not defined, `TokyoCabinet::FDB::NUMI64' is specified.%%
+    # The return value is a list object of the counts of the buckets.  Values out of the limits are not counted and the upper limit is included in the last bucket.%%
+    def histogram(lower, upper, buckets, interval, type)
+      # (native code)
+    end
     # Add an integer to a record.%%
     # `<i>key</i>' specifies the key.  It should be more than 0.  If it is "min", the minimum ID number of existing records is specified.  If it is "prev", the number less by one than the minimum ID number of existing records is specified.  If it is "max", the maximum ID number of existing records is specified.  If it is "next", the number greater by one than the maximum ID number of existing records is specified.%%
     # `<i>num</i>' specifies the additional value.%%
@@ -898,6 +1044,108 @@ module TokyoCabinet
       # (native code)
     end
   end
+  # Time series is a ring buffer of numeric values stored in a fixed-length database.%%
+  # Timestamps are divided by the resolution into buckets and each bucket is mapped to the ID number of the bucket modulo the capacity.  When the buckets wrap around, the oldest records are overwritten in place, so no rewrite or optimization is needed for retention.  The width of the database should be 16 or more.%%
+  class FDBTS
+    # aggregation: average
+    AGGAVG = 0
+    # aggregation: minimum
+    AGGMIN = 1
+    # aggregation: maximum
+    AGGMAX = 2
+    # aggregation: summation
+    AGGSUM = 3
+    # Create a time series object.%%
+    # `<i>fdb</i>' specifies the fixed-length database object.  It should be opened with the width of 16 bytes or more, else, an `ArgumentError' is raised.%%
+    # `<i>resolution</i>' specifies the resolution of timestamps.  Timestamps are integers such as UNIX time.%%
+    # `<i>capacity</i>' specifies the number of buckets kept.  If it is not defined, the limit ID number of the database is specified.%%
+    # The return value is the new time series object.%%
+    def initialize(fdb, resolution, capacity)
+      # (native code)
+    end
+    # Store a value.%%
+    # `<i>time</i>' specifies the timestamp.%%
+    # `<i>value</i>' specifies the real number value.%%
+    # If successful, the return value is true, else, it is false.%%
+    # If the bucket of the timestamp already has a value, it is overwritten.%%
+    def put(time, value)
+      # (native code)
+    end
+    # Retrieve a value.%%
+    # `<i>time</i>' specifies the timestamp.%%
+    # If successful, the return value is the value of the bucket of the timestamp.  `nil' is returned if the bucket has no value or has been overwritten.%%
+    def get(time)
+      # (native code)
+    end
+    # Retrieve downsampled values.%%
+    # `<i>from</i>' specifies the first timestamp.%%
+    # `<i>to</i>' specifies the last timestamp, which is inclusive.%%
+    # `<i>step</i>' specifies the length of each window.  It is rounded down to a multiple of the resolution.  If it is not defined, the resolution is specified.%%
+    # `<i>agg</i>' specifies the aggregation: `TokyoCabinet::FDBTS::AGGAVG', `TokyoCabinet::FDBTS::AGGMIN', `TokyoCabinet::FDBTS::AGGMAX', or `TokyoCabinet::FDBTS::AGGSUM'.  If it is not defined, `TokyoCabinet::FDBTS::AGGAVG' is specified.%%
+    # The return value is a list object of pairs of the starting timestamp and the aggregated value of each window which has values.  Windows are aligned to multiples of the step.%%
+    # The values are aggregated in C without the global interpreter lock.%%
+    def fetch(from, to, step, agg)
+      # (native code)
+    end
+  end
+  # Bitmap is a set of bits stored in a fixed-length database as 64-bit words.%%
+  # The bit of number `n' is kept in the record of the ID number `n / 64 + 1'.  Words without set bits are not stored.%%
+  # The words of `and', `or', and `andnot' are read and written while the global interpreter lock is held, so they do not interleave with updates by other threads.%%
+  class FDBBM
+    # Create a bitmap object.%%
+    # `<i>fdb</i>' specifies the fixed-length database object.  It should be opened with the width of 8 bytes or more, else, an `ArgumentError' is raised.%%
+    # The return value is the new bitmap object.%%
+    def initialize(fdb)
+      # (native code)
+    end
+    # Set a bit.%%
+    # `<i>num</i>' specifies the bit number, which is 0 or more.%%
+    # If successful, the return value is true, else, it is false.%%
+    def set(num)
+      # (native code)
+    end
+    # Clear a bit.%%
+    # `<i>num</i>' specifies the bit number, which is 0 or more.%%
+    # If successful, the return value is true, else, it is false.%%
+    def clear(num)
+      # (native code)
+    end
+    # Test a bit.%%
+    # `<i>num</i>' specifies the bit number, which is 0 or more.%%
+    # The return value is true if the bit is set, else, it is false.%%
+    def test(num)
+      # (native code)
+    end
+    # Count set bits.%%
+    # `<i>lower</i>' specifies the first bit number.  If it is not defined, 0 is specified.%%
+    # `<i>upper</i>' specifies the last bit number, which is inclusive.  If it is not defined, the last bit of the last word is specified.%%
+    # The return value is the number of set bits in the range.%%
+    # The words are counted in C without the global interpreter lock.%%
+    def count(lower, upper)
+      # (native code)
+    end
+    # Intersect with another bitmap.%%
+    # `<i>other</i>' specifies the other bitmap object.  If it is not a bitmap object, an `ArgumentError' is raised.%%
+    # If successful, the return value is true, else, it is false.%%
+    # The result is stored in the receiver.  Only words which change are written.%%
+    def and(other)
+      # (native code)
+    end
+    # Unite with another bitmap.%%
+    # `<i>other</i>' specifies the other bitmap object.  If it is not a bitmap object, an `ArgumentError' is raised.%%
+    # If successful, the return value is true, else, it is false.%%
+    # The result is stored in the receiver.  Only words which change are written.%%
+    def or(other)
+      # (native code)
+    end
+    # Subtract another bitmap.%%
+    # `<i>other</i>' specifies the other bitmap object.  If it is not a bitmap object, an `ArgumentError' is raised.%%
+    # If successful, the return value is true, else, it is false.%%
+    # The result is stored in the receiver.  Only words which change are written.%%
+    def andnot(other)
+      # (native code)
+    end
+  end
   # Table database is a file containing records composed of the primary keys and arbitrary columns and is handled with the table database API.  Before operations to store or retrieve records, it is necessary to open a database file and connect the table database object to it.  To avoid data missing or corruption, it is important to close every database file when it is no longer in use.%%
   # Except for the interface below, methods compatible with the `Hash' class are also provided; `[]', `[]=', `store', `delete', `fetch', `has_key?', `clear', `size', `empty?', `each', `each_key', `each_value', and `keys'.%%
   class TDB
@@ -975,12 +1223,24 @@ module TokyoCabinet
     ITLEXICAL = 0
     # index type: decimal string
     ITDECIMAL = 1
+    # index type: token inverted index
+    ITTOKEN = 2
+    # index type: q-gram inverted index
+    ITQGRAM = 3
     # index type: optimize
     ITOPT = 9998
     # index type: void
     ITVOID = 9999
     # index type: keep existing index
     ITKEEP = 1 << 24
+    # column type: string
+    CTSTR = 0
+    # column type: integer
+    CTINT = 1
+    # column type: real number
+    CTFLOAT = 2
+    # column type: boolean
+    CTBOOL = 3
     # Create a table database object.%%
     # The return value is the new table database object.%%
     def initialize()
@@ -1023,6 +1283,14 @@ module TokyoCabinet
     def setxmsiz(xmsiz)
       # (native code)
     end
+    # Adjust the caching parameters of the column indices of the opened database.%%
+    # `<i>ratio</i>' specifies the target ratio of pages resident in the caches to all pages of each index.  1.0 means that all pages are cached.%%
+    # `<i>limit</i>' specifies the size limit of memory in bytes for the caches of all opened database objects in the process.  If it is not defined or not more than 0, no limit is specified.%%
+    # If successful, the return value is true, else, it is false.  If the limit cannot hold the minimum caches of all indices, the parameters are not changed and false is returned.  False is also returned if the library is not a version whose internal layout is known to the binding.%%
+    # The limit is shared with `TokyoCabinet::BDB#adjcache'.  The caches are not adjusted automatically, so this method should be called periodically.%%
+    def adjcache(ratio, limit)
+      # (native code)
+    end
     # Open a database file.%%
     # `<i>path</i>' specifies the path of the database file.%%
     # `<i>omode</i>' specifies the connection mode: `TokyoCabinet::TDB::OWRITER' as a writer, `TokyoCabinet::TDB::OREADER' as a reader.  If the mode is `TokyoCabinet::TDB::OWRITER', the following may be added by bitwise-or: `TokyoCabinet::TDB::OCREAT', which means it creates a new database if not exist, `TokyoCabinet::TDB::OTRUNC', which means it creates a new database regardless if one exists, `TokyoCabinet::TDB::OTSYNC', which means every transaction synchronizes updated contents with the device.  Both of `TokyoCabinet::TDB::OREADER' and `TokyoCabinet::TDB::OWRITER' can be added to by bitwise-or: `TokyoCabinet::TDB::ONOLCK', which means it opens the database file without file locking, or `TokyoCabinet::TDB::OLCKNB', which means locking is performed without blocking.  If it is not defined, `TokyoCabinet::TDB::OREADER' is specified.%%
@@ -1068,8 +1336,17 @@ module TokyoCabinet
     end
     # Retrieve a record.%%
     # `<i>pkey</i>' specifies the primary key.%%
+    # `<i>names</i>' specifies a list object of the column names to be retrieved.  If it is not defined, all columns are retrieved.%%
     # If successful, the return value is a hash of the columns of the corresponding record.  `nil' is returned if no record corresponds.%%
-    def get(pkey)
+    # If `<i>names</i>' is specified, string objects are created only for the specified columns which exist.%%
+    def get(pkey, names)
+      # (native code)
+    end
+    # Retrieve a column of a record.%%
+    # `<i>pkey</i>' specifies the primary key.%%
+    # `<i>name</i>' specifies the name of the column.%%
+    # If successful, the return value is the value of the column.  `nil' is returned if no record corresponds or the record does not have the column.%%
+    def getcol(pkey, name)
       # (native code)
     end
     # Get the size of the value of a record.%%
@@ -1177,11 +1454,32 @@ module TokyoCabinet
     end
     # Set a column index.%%
     # `<i>name</i>' specifies the name of a column.  If the name of an existing index is specified, the index is rebuilt.  An empty string means the primary key.%%
-    # `<i>type</i>' specifies the index type: `TokyoCabinet::TDB::ITLEXICAL' for lexical string, `TokyoCabinet::TDB::ITDECIMAL' for decimal string.  If it is `TokyoCabinet::TDB::ITOPT', the index is optimized.  If it is `TokyoCabinet::TDB::ITVOID', the index is removed.  If `TokyoCabinet::TDB::ITKEEP' is added by bitwise-or and the index exists, this method merely returns failure.%%
+    # `<i>type</i>' specifies the index type: `TokyoCabinet::TDB::ITLEXICAL' for lexical string, `TokyoCabinet::TDB::ITDECIMAL' for decimal string, `TokyoCabinet::TDB::ITTOKEN' for token inverted index, `TokyoCabinet::TDB::ITQGRAM' for q-gram inverted index.  If it is `TokyoCabinet::TDB::ITOPT', the index is optimized.  If it is `TokyoCabinet::TDB::ITVOID', the index is removed.  If `TokyoCabinet::TDB::ITKEEP' is added by bitwise-or and the index exists, this method merely returns failure.%%
 # If successful, the return value is true, else, it is false.%%
     def setindex(name, type)
       # (native code)
     end
+    # Begin a bulk load.%%
+    # If successful, the return value is true, else, it is false.%%
+    # All column indices are recorded and removed so that stored records do not update them one by one.  Records can be searched during a bulk load, but without the indices.  If the database is closed during a bulk load, the indices are created again before closing.%%
+    # The definitions of the removed indices are saved in a file whose name is the path of the database with the suffix ".bulk".  If the object is destroyed without `bulkend' or `close', the indices are created again before the database is closed.  If the process ends abnormally, they are created again when the database is opened as a writer next time.  If an index cannot be removed, the removed indices are created again and false is returned.%%
+    def bulkbegin()
+      # (native code)
+    end
+    # End a bulk load.%%
+    # If successful, the return value is true, else, it is false.%%
+    # The indices removed by `bulkbegin' are created again, each of which is built in one pass over all records.  The indices are built without the global interpreter lock.%%
+    def bulkend()
+      # (native code)
+    end
+    # Set the schema of column types.%%
+    # `<i>schema</i>' specifies a hash of the names of columns and their types: `TokyoCabinet::TDB::CTSTR' for string, `TokyoCabinet::TDB::CTINT' for integer, `TokyoCabinet::TDB::CTFLOAT' for real number, `TokyoCabinet::TDB::CTBOOL' for boolean.  If it is `nil', the schema is cleared.%%
+    # `<i>cls</i>' specifies a class created by `Struct' whose members are names of columns.  If it is defined, records are retrieved as instances of the class.  If it is not a subclass of `Struct', `ArgumentError' is raised.%%
+    # If successful, the return value is true, else, it is false.%%
+    # Values are still stored as decimal strings so that decimal indices and numeric conditions work.  Typed columns are decoded by `get', `getcol', and `TokyoCabinet::TDBQRY#searchrows' directly into numbers and booleans.  Real numbers are stored in the shortest form which reads back as the same value.  A boolean column is false if it is empty, "0", or "false".%%
+    def setschema(schema, cls)
+      # (native code)
+    end
     # Generate a unique ID number.%%
     # The return value is the new unique ID number or -1 on failure.%%
     def genuid()
@@ -1220,6 +1518,14 @@ module TokyoCabinet
     QCNUMBT = 14
     # query condition: number is equal to at least one token in
     QCNUMOREQ = 15
+    # query condition: full-text search with the phrase of
+    QCFTSPH = 16
+    # query condition: full-text search with all tokens in
+    QCFTSAND = 17
+    # query condition: full-text search with at least one token in
+    QCFTSOR = 18
+    # query condition: full-text search with the compound expression of
+    QCFTSEX = 19
     # query condition: negation flag
     QCNEGATE = 1 << 24
     # query condition: no index flag
@@ -1238,6 +1544,30 @@ module TokyoCabinet
     QPOUT = 1 << 1
     # post treatment: stop the iteration
     QPSTOP = 1 << 24
+    # set operation type: union
+    MSUNION = 0
+    # set operation type: intersection
+    MSISECT = 1
+    # set operation type: difference
+    MSDIFF = 2
+    # update type: assign
+    QUSET = 0
+    # update type: add
+    QUADD = 1
+    # update type: concatenate
+    QUCAT = 2
+    # update type: remove column
+    QUDEL = 3
+    # aggregation type: count
+    AGGCOUNT = 0
+    # aggregation type: summation
+    AGGSUM = 1
+    # aggregation type: minimum
+    AGGMIN = 2
+    # aggregation type: maximum
+    AGGMAX = 3
+    # aggregation type: average
+    AGGAVG = 4
     # Create a query object.%%
     # `<i>tdb</i>' specifies the table database object.%%
     # The return value is the new query object.%%
@@ -1246,8 +1576,8 @@ module TokyoCabinet
     end
     # Add a narrowing condition.%%
     # `<i>name</i>' specifies the name of a column.  An empty string means the primary key.%%
-    # `<i>op</i>' specifies an operation type: `TokyoCabinet::TDBQRY::QCSTREQ' for string which is equal to the expression, `TokyoCabinet::TDBQRY::QCSTRINC' for string which is included in the expression, `TokyoCabinet::TDBQRY::QCSTRBW' for string which begins with the expression, `TokyoCabinet::TDBQRY::QCSTREW' for string which ends with the expression, `TokyoCabinet::TDBQRY::QCSTRAND' for string which includes all tokens in the expression, `TokyoCabinet::TDBQRY::QCSTROR' for string which includes at least one token in the expression, `TokyoCabinet::TDBQRY::QCSTROREQ' for string which is equal to at least one token in the expression, `TokyoCabinet::TDBQRY::QCSTRRX' for string which matches regular expressions of the expression, `TokyoCabinet::TDBQRY::QCNUMEQ' for number which is equal to the expression, `TokyoCabinet::TDBQRY::QCNUMGT' for number which is greater than the expression, `TokyoCabinet::TDBQRY::QCNUMGE' for number which is greater than or equal to the expression, `TokyoCabinet::TDBQRY::QCNUMLT' for number which is less than the expression, `TokyoCabinet::TDBQRY::QCNUMLE' for number which is less than or equal to the expression, `TokyoCabinet::TDBQRY::QCNUMBT' for number which is between two tokens of the expression, `TokyoCabinet::TDBQRY::QCNUMOREQ' for number which is equal to at least one token in the expression.  All operations can be flagged by bitwise-or: `TokyoCabinet::TDBQRY::QCNEGATE' for negation, `TokyoCabinet::TDBQRY::QCNOIDX' for using no index.%%
-    # `<i>expr</i>' specifies an operand exression.%%
+    # `<i>op</i>' specifies an operation type: `TokyoCabinet::TDBQRY::QCSTREQ' for string which is equal to the expression, `TokyoCabinet::TDBQRY::QCSTRINC' for string which is included in the expression, `TokyoCabinet::TDBQRY::QCSTRBW' for string which begins with the expression, `TokyoCabinet::TDBQRY::QCSTREW' for string which ends with the expression, `TokyoCabinet::TDBQRY::QCSTRAND' for string which includes all tokens in the expression, `TokyoCabinet::TDBQRY::QCSTROR' for string which includes at least one token in the expression, `TokyoCabinet::TDBQRY::QCSTROREQ' for string which is equal to at least one token in the expression, `TokyoCabinet::TDBQRY::QCSTRRX' for string which matches regular expressions of the expression, `TokyoCabinet::TDBQRY::QCNUMEQ' for number which is equal to the expression, `TokyoCabinet::TDBQRY::QCNUMGT' for number which is greater than the expression, `TokyoCabinet::TDBQRY::QCNUMGE' for number which is greater than or equal to the expression, `TokyoCabinet::TDBQRY::QCNUMLT' for number which is less than the expression, `TokyoCabinet::TDBQRY::QCNUMLE' for number which is less than or equal to the expression, `TokyoCabinet::TDBQRY::QCNUMBT' for number which is between two tokens of the expression, `TokyoCabinet::TDBQRY::QCNUMOREQ' for number which is equal to at least one token in the expression, `TokyoCabinet::TDBQRY::QCFTSPH' for full-text search with the phrase of the expression, `TokyoCabinet::TDBQRY::QCFTSAND' for full-text search with all tokens in the expression, `TokyoCabinet::TDBQRY::QCFTSOR' for full-text search with at least one token in the expression, `TokyoCabinet::TDBQRY::QCFTSEX' for full-text search with the compound expression.  All operations can be flagged by bitwise-or: `TokyoCabinet::TDBQRY::QCNEGATE' for negation, `TokyoCabinet::TDBQRY::QCNOIDX' for using no index.%%
+    # `<i>expr</i>' specifies an operand exression.  If it is a symbol, it is a placeholder which is bound by the `execute' method.  The other search methods raise `ArgumentError' while the query has placeholders.%%
     # The return value is always `nil'.%%
     def addcond(name, op, expr)
       # (native code)
@@ -1271,15 +1601,76 @@ module TokyoCabinet
     def search()
       # (native code)
     end
+    # Execute the search and retrieve the corresponding records.%%
+    # `<i>names</i>' specifies a list object of the column names to be retrieved.  If it is not defined, all columns are retrieved.%%
+    # The return value is an array of pairs of the primary key and a hash of the columns of each corresponding record, in the order of the search result.  This method does never fail and return an empty array even if no record corresponds.%%
+    # The records are fetched in one batch without the global interpreter lock, so the primary keys are not passed back to Ruby to be looked up one by one.%%
+    # If every specified column is the primary key or has a lexical or decimal index limited by a condition of the query, the values are read from the indices instead of the records.  If much more of an index than the result would be read, the records are fetched instead.  The table is locked for reading while the indices are read, and records removed after the search are left out as when the records are fetched.%%
+    def searchrows(names)
+      # (native code)
+    end
+    # Execute the search with bound placeholders.%%
+    # `<i>binds</i>' specifies a hash whose keys are the symbols of the placeholders and whose values are the expressions.  If it is not defined, no placeholder can be bound.%%
+    # The return value is an array of the primary keys of the corresponding records.  If a placeholder is not bound, an exception is raised.%%
+    # The conditions, the order, and the limit added to the query object are recorded and a separate native query is built for each execution, so one query object can be executed by multiple threads with different bindings.%%
+    def execute(binds)
+      # (native code)
+    end
+    # Retrieve records with multiple query objects and get the set of the result.%%
+    # `<i>others</i>' specifies an array of the query objects except for the self object.  They must be created with the same database object as the self object, or else `ArgumentError' is raised.%%
+    # `<i>type</i>' specifies a set operation type: `TokyoCabinet::TDBQRY::MSUNION' for the union set, `TokyoCabinet::TDBQRY::MSISECT' for the intersection set, `TokyoCabinet::TDBQRY::MSDIFF' for the difference set.  If it is not defined, `TokyoCabinet::TDBQRY::MSUNION' is specified.%%
+    # The return value is an array of the primary keys of the corresponding records.  This method does never fail and return an empty array even if no record corresponds.%%
+    # If the first query object has the order setting, the result array is sorted by the order.  The limit setting of the first query object is also applied.%%
+    def metasearch(others, type)
+      # (native code)
+    end
+    # Get the number of the corresponding records.%%
+    # The return value is the number of the corresponding records, which is the same as the size of the result of `search'.%%
+    # No string object is created for the primary keys and the search is performed without the global interpreter lock.%%
+    def count()
+      # (native code)
+    end
+    # Check whether any record corresponds.%%
+    # The return value is true if at least one record corresponds, else, it is false.%%
+    # The order and the limit settings are ignored so that the search stops at the first corresponding record.%%
+    def exists?()
+      # (native code)
+    end
+    # Aggregate the corresponding records by groups.%%
+    # `<i>gname</i>' specifies the name of the grouping column.  If it is `nil', all corresponding records make one group whose key is `nil'.  Records without the column are grouped under the empty string.%%
+    # `<i>specs</i>' specifies an array of pairs of an aggregation type and the name of a column: `TokyoCabinet::TDBQRY::AGGCOUNT' for the number of values, `TokyoCabinet::TDBQRY::AGGSUM' for the summation, `TokyoCabinet::TDBQRY::AGGMIN' for the minimum, `TokyoCabinet::TDBQRY::AGGMAX' for the maximum, `TokyoCabinet::TDBQRY::AGGAVG' for the average.  If the name of the column is `nil' or empty, `TokyoCabinet::TDBQRY::AGGCOUNT' counts the records.%%
+    # The return value is a hash of the values of the grouping column and arrays of the aggregated values in the order of `<i>specs</i>'.  The minimum, the maximum, and the average are `nil' if the group has no value of the column.%%
+    # The records are read and aggregated in C without the global interpreter lock, so string objects are created only for the result.  Column values are parsed as real numbers.%%
+    def aggregate(gname, specs)
+      # (native code)
+    end
+    # Update each corresponding record with expressions.%%
+    # `<i>exprs</i>' specifies an array of expressions, each of which is an array of an update type, the name of a column, and an operand: `TokyoCabinet::TDBQRY::QUSET' to assign the operand, `TokyoCabinet::TDBQRY::QUADD' to add the operand, which is an integer or a real number, `TokyoCabinet::TDBQRY::QUCAT' to concatenate the operand, `TokyoCabinet::TDBQRY::QUDEL' to remove the column.  The operand of `TokyoCabinet::TDBQRY::QUDEL' is ignored.%%
+    # If successful, the return value is the number of updated records, else, it is -1.%%
+    # The expressions are applied in C without the global interpreter lock and without calling any block.  All records are updated in one transaction.  If the current thread has begun a transaction with `TokyoCabinet::TDB#tranbegin', the records are updated in it.  If another thread has, this method waits until that transaction ends.  If no expression is specified, no record is updated and 0 is returned.  If an integer addition overflows, it is an error and the records of the own transaction are not updated.%%
+    def update(exprs)
+      # (native code)
+    end
+    # Get the primary keys of the top records by a column.%%
+    # `<i>k</i>' specifies the maximum number of records to be retrieved.%%
+    # `<i>name</i>' specifies the name of the column.  An empty string means the primary key.%%
+    # `<i>type</i>' specifies the order type as with `setorder'.%%
+    # The return value is an array of the primary keys of at most `<i>k</i>' corresponding records in the order.  This method does never fail.  It returns an empty array even if no record corresponds.%%
+    # The order and the limit settings of the query object are ignored.  If the column has a lexical index for a string order or a decimal index for a numeric order, the index is walked in the order until enough records correspond.  Otherwise, the corresponding records are selected through a bounded heap of `<i>k</i>' elements instead of sorting all of them.  The search is performed without the global interpreter lock.%%
+    def top(k, name, type)
+      # (native code)
+    end
     # Remove each corresponding record.%%
     # If successful, the return value is true, else, it is false.%%
     def searchout()
       # (native code)
     end
     # Process each corresponding record.%%
-    # This function needs a block parameter of the iterator called for each record.  The block receives two parameters.  The first parameter is the primary key.  The second parameter is a hash containing columns.  It returns flags of the post treatment by bitwise-or: `TokyoCabinet::TDBQRY::QPPUT' to modify the record, `TokyoCabinet::TDBQRY::QPOUT' to remove the record, `TokyoCabinet::TDBQRY::QPSTOP' to stop the iteration.%%
+    # `<i>lazy</i>' specifies whether the block receives a row object instead of a hash.  If it is not defined, false is specified.%%
+    # This function needs a block parameter of the iterator called for each record.  The block receives two parameters.  The first parameter is the primary key.  The second parameter is a hash containing columns, or a `TokyoCabinet::TDBROW' object if `<i>lazy</i>' is true.  It returns flags of the post treatment by bitwise-or: `TokyoCabinet::TDBQRY::QPPUT' to modify the record, `TokyoCabinet::TDBQRY::QPOUT' to remove the record, `TokyoCabinet::TDBQRY::QPSTOP' to stop the iteration.%%
     # If successful, the return value is true, else, it is false.%%
-    def proc()
+    # In the lazy mode, string objects are created only for the columns which are read, modifications are applied to the record in place, and `TokyoCabinet::TDBQRY::QPPUT' is ignored if no column has been modified.%%
+    def proc(lazy)
       # (native code)
     end
     # Get the hint of a query object.%%
@@ -1288,4 +1679,87 @@ module TokyoCabinet
       # (native code)
     end
   end
+  # Row is a view of a record processed by `TokyoCabinet::TDBQRY#proc' in the lazy mode.%%
+  # A row object is valid only while the block is called.%%
+  class TDBROW
+    # Retrieve a column.%%
+    # `<i>name</i>' specifies the name of the column.%%
+    # If successful, the return value is the value of the column.  `nil' is returned if the record does not have the column.%%
+    def [](name)
+      # (native code)
+    end
+    # Store a column.%%
+    # `<i>name</i>' specifies the name of the column.%%
+    # `<i>value</i>' specifies the value.  If it is `nil', the column is removed.%%
+    # The return value is the value.  The row is marked as modified only if the value differs from the current one.%%
+    def []=(name, value)
+      # (native code)
+    end
+    # Remove a column.%%
+    # `<i>name</i>' specifies the name of the column.%%
+    # If successful, the return value is true, else, it is false.  False is returned when the record does not have the column.%%
+    def delete(name)
+      # (native code)
+    end
+    # Get a hash of all columns.%%
+    # The return value is a hash containing columns.%%
+    def to_hash()
+      # (native code)
+    end
+    # Check whether any column has been modified.%%
+    # The return value is true if any column has been modified, else, it is false.%%
+    def changed?()
+      # (native code)
+    end
+  end
+  # Sharded table database is a set of table databases where each record is stored in one of them by the hash value of the primary key.%%
+  # The table databases should be opened by the caller.  Indices should be set on every table database.%%
+  class TDBSHARD
+    # Create a sharded table database object.%%
+    # `<i>tdbs</i>' specifies an array of the table database objects of the shards.  The order of the array should be kept for the same set of files.%%
+    # The return value is the new sharded table database object.%%
+    def initialize(tdbs)
+      # (native code)
+    end
+    # Get the index of the shard of a record.%%
+    # `<i>pkey</i>' specifies the primary key.%%
+    # The return value is the index of the table database storing the record.%%
+    def shard(pkey)
+      # (native code)
+    end
+    # Store a record.%%
+    # `<i>pkey</i>' specifies the primary key.%%
+    # `<i>cols</i>' specifies a hash containing columns.%%
+    # If successful, the return value is true, else, it is false.%%
+    # If a record with the same key exists in the shard, it is overwritten.%%
+    def put(pkey, cols)
+      # (native code)
+    end
+    # Remove a record.%%
+    # `<i>pkey</i>' specifies the primary key.%%
+    # If successful, the return value is true, else, it is false.%%
+    def out(pkey)
+      # (native code)
+    end
+    # Retrieve a record.%%
+    # `<i>pkey</i>' specifies the primary key.%%
+    # `<i>names</i>' specifies an array of the names of the columns to be retrieved.  If it is not defined, all columns are retrieved.%%
+    # If successful, the return value is a hash of the columns of the corresponding record.  `nil' is returned if no record corresponds.%%
+    def get(pkey, names)
+      # (native code)
+    end
+    # Get the number of records.%%
+    # The return value is the total number of the records of all shards.%%
+    def rnum()
+      # (native code)
+    end
+    # Execute a query on all shards.%%
+    # `<i>qry</i>' specifies the query object whose conditions, order, and limit are applied.  The table database of the query object is not used.%%
+    # `<i>binds</i>' specifies a hash of the values of placeholders.  If it is not defined, the query should have no placeholder.%%
+    # The return value is an array of the primary keys of the corresponding records.  This method does never fail.  It returns an empty array even if no record corresponds.%%
+    # The shards are searched in parallel threads without the global interpreter lock.  Each shard returns at most the sum of the limit and the skip, and the results are merged in the order of the query.%%
+    def search(qry, binds)
+      # (native code)
+    end
+  end
 end
@@ -15,24 +15,46 @@
 
 
 #include "ruby.h"
+#if defined(HAVE_RB_THREAD_CALL_WITHOUT_GVL)
+#include "ruby/thread.h"
+#endif
 #include <tcutil.h>
 #include <tchdb.h>
 #include <tcbdb.h>
 #include <tcfdb.h>
 #include <tctdb.h>
 #include <stdlib.h>
+#include <stdio.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <limits.h>
+#include <float.h>
 #include <math.h>
+#include <pthread.h>
+#include <unistd.h>
 
 #define HDBVNDATA      "@hdb"
 #define BDBVNDATA      "@bdb"
 #define BDBCURVNDATA   "@bdbcur"
 #define FDBVNDATA      "@fdb"
+#define FDBTSVNDATA    "@fdbts"
 #define TDBVNDATA      "@tdb"
+#define TDBVNSCHEMA    "@tdbschema"
+#define TDBVNBULK      "@tdbbulk"
+#define TDBVNTRAN      "@tdbtran"
 #define TDBQRYVNDATA   "@tdbqry"
+#define TDBQRYVNTPL    "@tdbqrytpl"
+#define TDBROWVNDATA   "@tdbrow"
+#define TDBSHARDVNDATA "@tdbshard"
 #define NUMBUFSIZ      32
+#define CACHEMINNUM    64
+#define PARTMAXNUM     256
+#define PARTRECNUM     1024
+#define QWAITSLICE     0.01
+#define MGETSTEPNUM    8
+#define AGGBUFNUM      256
+#define COVERSCANMUL   4
+#define COVERSCANMIN   256
 
 #if !defined(RSTRING_PTR)
 #define RSTRING_PTR(TC_s) (RSTRING(TC_s)->ptr)
@@ -43,6 +65,269 @@
 #if !defined(RARRAY_LEN)
 #define RARRAY_LEN(TC_a) (RARRAY(TC_a)->len)
 #endif
+#if defined(_TC_LIBVER) && _TC_LIBVER >= 906 && _TC_LIBVER <= 911
+#define HAVE_TC_LAYOUT 1
+#endif
+#if defined(HAVE_RB_THREAD_CALL_WITHOUT_GVL)
+#define NOGVLCALL(TC_func, TC_arg) \
+  rb_thread_call_without_gvl((void *(*)(void *))(TC_func), (TC_arg), RUBY_UBF_IO, NULL)
+#else
+#define NOGVLCALL(TC_func, TC_arg) \
+  ((TC_func)(TC_arg))
+#endif
+
+typedef struct {                         /* type of structure for a partition of parallel scan */
+  TCBDB *bdb;                            /* database object */
+  BDBCUR *cur;                           /* cursor object */
+  char *ekbuf;                           /* end key of the partition */
+  int eksiz;                             /* size of the end key */
+  bool einc;                             /* whether the end key is included */
+  bool done;                             /* whether the partition is finished */
+  TCLIST *recs;                          /* keys and values read in the current round */
+  pthread_t th;                          /* thread of the current round */
+  bool live;                             /* whether the thread of the current round is running */
+} BDBPART;
+
+typedef struct {                         /* type of structure for partitions of parallel scan */
+  BDBPART *parts;                        /* array of partitions */
+  int pnum;                              /* number of partitions */
+  bool nogvl;                            /* whether to scan without the global lock */
+} BDBPARTS;
+
+typedef struct {                         /* type of structure for a dequeuing operation */
+  TCBDB *bdb;                            /* database object */
+  BDBCUR *cur;                           /* cursor object */
+  TCXSTR *kxstr;                         /* buffer of the key */
+  TCXSTR *vxstr;                         /* buffer of the value */
+  VALUE vary;                            /* array of the removed records */
+  int num;                               /* maximum number of records */
+  bool last;                             /* whether to take records from the end */
+  bool wait;                             /* whether to wait for a record */
+  double deadline;                       /* time limit of waiting */
+  bool waiting;                          /* whether the thread is counted as a waiter */
+} BDBPOP;
+
+typedef struct {                         /* type of structure for a sorted multiple retrieval */
+  TCBDB *bdb;                            /* database object */
+  BDBCUR *cur;                           /* cursor object */
+  VALUE vstrs;                           /* array of the keys */
+  VALUE vary;                            /* array of the values */
+  int *idxs;                             /* indices of the keys in sorted order */
+  int num;                               /* number of the keys */
+} BDBMGET;
+
+typedef struct {                         /* type of structure for a range removal */
+  TCBDB *bdb;                            /* database object */
+  BDBCUR *cur;                           /* cursor object */
+  const char *bkbuf;                     /* beginning key */
+  int bksiz;                             /* size of the beginning key */
+  bool binc;                             /* whether the beginning key is included */
+  const char *ekbuf;                     /* ending key */
+  int eksiz;                             /* size of the ending key */
+  bool einc;                             /* whether the ending key is included */
+  bool tran;                             /* whether to run in a transaction */
+  int64_t num;                           /* number of removed records */
+  bool done;                             /* whether the removal has finished */
+} BDBOUT;
+
+enum {                                   /* enumeration for numeric types of FDB records */
+  FDBNUMI64,                             /* 64-bit integer */
+  FDBNUMF64                              /* 64-bit real number */
+};
+
+typedef struct {                         /* type of structure for aggregation over FDB records */
+  TCFDB *fdb;                            /* database object */
+  int64_t lower;                         /* lower limit of ID numbers */
+  int64_t upper;                         /* upper limit of ID numbers */
+  int type;                              /* numeric type of records */
+  int64_t cnt;                           /* number of aggregated records */
+  int64_t isum;                          /* summation of integers */
+  int64_t imin;                          /* minimum of integers */
+  int64_t imax;                          /* maximum of integers */
+  double dsum;                           /* summation of real numbers */
+  double dmin;                           /* minimum of real numbers */
+  double dmax;                           /* maximum of real numbers */
+  double hlow;                           /* lower limit of the histogram */
+  double hupp;                           /* upper limit of the histogram */
+  int bnum;                              /* number of buckets of the histogram */
+  int64_t *buckets;                      /* counts of the buckets */
+} FDBAGG;
+
+typedef struct {                         /* type of structure for a time series on FDB */
+  TCFDB *fdb;                            /* database object */
+  int64_t res;                           /* resolution of timestamps */
+  int64_t cap;                           /* number of slots */
+} FDBTS;
+
+typedef struct {                         /* type of structure for a record of a time series */
+  int64_t bucket;                        /* timestamp divided by the resolution */
+  double value;                          /* value */
+} FDBTSREC;
+
+enum {                                   /* enumeration for aggregation of a time series */
+  FDBTSAGGAVG,                           /* average */
+  FDBTSAGGMIN,                           /* minimum */
+  FDBTSAGGMAX,                           /* maximum */
+  FDBTSAGGSUM                            /* summation */
+};
+
+typedef struct {                         /* type of structure for a downsampled read of a time series */
+  FDBTS *ts;                             /* time series object */
+  int64_t bbeg;                          /* first bucket */
+  int64_t bend;                          /* last bucket */
+  int64_t wbnum;                         /* number of buckets per window */
+  int64_t wbeg;                          /* index of the first window */
+  int agg;                               /* aggregation type */
+  double *vals;                          /* aggregated values of the windows */
+  int64_t *cnts;                         /* numbers of records of the windows */
+} FDBTSREAD;
+
+enum {                                   /* enumeration for operations between bitmaps */
+  FDBBMOPAND,                            /* intersection */
+  FDBBMOPOR,                             /* union */
+  FDBBMOPANDNOT                          /* difference */
+};
+
+typedef struct {                         /* type of structure for a scan of bitmaps */
+  TCFDB *fdb;                            /* database object */
+  TCFDB *ofdb;                           /* database object of the other operand */
+  int op;                                /* operation type */
+  int64_t lower;                         /* first bit */
+  int64_t upper;                         /* last bit */
+  int64_t cnt;                           /* number of set bits */
+  bool err;                              /* whether an error occurred */
+} FDBBMOP;
+
+typedef struct {                         /* type of structure for decoding a TDB record */
+  VALUE vtdb;                            /* database object of Ruby */
+  TCMAP *cols;                           /* columns of the record */
+  VALUE vnames;                          /* names of the retrieved columns */
+} TDBDECODE;
+
+typedef struct {                         /* type of structure for a deferred index build */
+  TCTDB *tdb;                            /* database object */
+  bool err;                              /* whether an error occurred */
+} TDBBULK;
+
+enum {                                   /* enumeration for column types of TDB schemas */
+  TDBCTSTR,                              /* string */
+  TDBCTINT,                              /* integer */
+  TDBCTFLOAT,                            /* real number */
+  TDBCTBOOL                              /* boolean */
+};
+
+typedef struct {                         /* type of structure for a column read from its index */
+  char *name;                            /* name of the column or empty for the primary key */
+  char *prefix;                          /* prefix of values of a lexical index */
+  bool exact;                            /* whether values should be equal to the prefix */
+  double lower;                          /* lower limit of values of a decimal index */
+  double upper;                          /* upper limit of values of a decimal index */
+} TDBQRYCOVCOL;
+
+typedef struct {                         /* type of structure for a covering search */
+  TCTDB *tdb;                            /* database object */
+  TDBQRYCOVCOL *cols;                    /* columns to be read */
+  int cnum;                              /* number of the columns */
+  TCLIST *pkeys;                         /* primary keys of the result */
+  TCMAP **rows;                          /* columns of the records */
+  bool miss;                             /* whether the records should be fetched instead */
+} TDBQRYCOVER;
+
+typedef struct {                         /* type of structure for a batched fetch of TDB records */
+  TCTDB *tdb;                            /* database object */
+  TCLIST *pkeys;                         /* primary keys */
+  TCMAP **rows;                          /* fetched records */
+  VALUE vtdb;                            /* database object of Ruby */
+  VALUE vnames;                          /* names of the retrieved columns */
+  TDBQRYCOVER *cov;                      /* covering search or `NULL' */
+} TDBROWS;
+
+enum {                                   /* enumeration for entries of query templates */
+  TDBQRYTCOND,                           /* condition */
+  TDBQRYTORDER,                          /* order */
+  TDBQRYTLIMIT                           /* limit */
+};
+
+typedef struct {                         /* type of structure for a row of a query process */
+  TCMAP *cols;                           /* columns of the current record */
+  bool dirty;                            /* whether any column has been modified */
+} TDBROW;
+
+typedef struct {                         /* type of structure for a lazy query process */
+  TDBQRY *qry;                           /* query object */
+  TDBROW *row;                           /* row of the current record */
+  VALUE vrow;                            /* row object passed to the block */
+} TDBQRYPROCOP;
+
+enum {                                   /* enumeration for expressions of query updates */
+  TDBQRYUSET,                            /* assignment */
+  TDBQRYUADD,                            /* addition */
+  TDBQRYUCAT,                            /* concatenation */
+  TDBQRYUDEL                             /* removal */
+};
+
+typedef struct {                         /* type of structure for a query update */
+  TDBQRY *qry;                           /* query object */
+  int *ops;                              /* types of the expressions */
+  const char **names;                    /* names of the columns */
+  const char **vals;                     /* operands of the expressions */
+  bool *reals;                           /* whether each addition is of real numbers */
+  int unum;                              /* number of the expressions */
+  bool tran;                             /* whether to run in an own transaction */
+  int64_t cnt;                           /* number of updated records */
+  bool err;                              /* whether an error occurred */
+} TDBQRYUPD;
+
+enum {                                   /* enumeration for aggregation of query results */
+  TDBQRYAGGCOUNT,                        /* count */
+  TDBQRYAGGSUM,                          /* summation */
+  TDBQRYAGGMIN,                          /* minimum */
+  TDBQRYAGGMAX,                          /* maximum */
+  TDBQRYAGGAVG                           /* average */
+};
+
+typedef struct {                         /* type of structure for an accumulator of aggregation */
+  int64_t cnt;                           /* number of values */
+  double sum;                            /* summation of values */
+  double min;                            /* minimum of values */
+  double max;                            /* maximum of values */
+} TDBQRYACC;
+
+typedef struct {                         /* type of structure for aggregation of query results */
+  TDBQRY *qry;                           /* query object */
+  const char *gname;                     /* name of the grouping column */
+  const char **names;                    /* names of the aggregated columns */
+  int anum;                              /* number of the aggregated columns */
+  TCMAP *groups;                         /* accumulators of the groups */
+} TDBQRYAGG;
+
+typedef struct {                         /* type of structure for a candidate of a top-k query */
+  int idx;                               /* index in the search result */
+  char *vbuf;                            /* value of the order column */
+  int vsiz;                              /* size of the value */
+} TDBQRYTOPENT;
+
+typedef struct {                         /* type of structure for a top-k query */
+  TDBQRY *qry;                           /* query object */
+  const char *oname;                     /* name of the order column */
+  int otype;                             /* order type */
+  int k;                                 /* number of records to be retrieved */
+  bool indexed;                          /* whether the order column has a usable index */
+  TCLIST *res;                           /* primary keys of the result */
+} TDBQRYTOP;
+
+typedef struct {                         /* type of structure for a shard of a sharded search */
+  TDBQRY *qry;                           /* query object for the shard */
+  TCLIST *res;                           /* primary keys of the result */
+  TCLIST *okeys;                         /* values of the order column of the result */
+  pthread_t th;                          /* thread of the search */
+  bool live;                             /* whether the thread is running */
+} TDBSHARDSCAN;
+
+typedef struct {                         /* type of structure for a sharded search */
+  TDBSHARDSCAN *scans;                   /* array of shards */
+  int num;                               /* number of shards */
+} TDBSHARDRUN;
 
 
 /* private function prototypes */
@@ -51,6 +336,26 @@ static TCLIST *varytolist(VALUE vary);
 static VALUE listtovary(TCLIST *list);
 static TCMAP *vhashtomap(VALUE vhash);
 static VALUE maptovhash(TCMAP *map);
+static VALUE maptovhash2(TCMAP *map, VALUE vnames);
+static int64_t cacheavail(const void *obj, int64_t limit);
+static void cachegrant(const void *obj, int64_t size);
+static int64_t bdbcachepsiz(TCBDB *bdb);
+static int64_t bdbadjcache(TCBDB *bdb, double ratio, int64_t avail);
+static int64_t tdbadjcache(TCTDB *tdb, double ratio, int64_t avail);
+static void bdbqnotify(void);
+static int64_t bdbsplitnum(int64_t lnum, int64_t hnum, int i, int num);
+static int64_t fdbkeytoid(VALUE vkey);
+static int64_t fdbresolveid(TCFDB *fdb, int64_t id);
+static void *bdbqwait(double *deadline);
+static int tdbcoltype(VALUE vtdb, VALUE vname);
+static VALUE tdbdecodeval(int type, const char *vbuf, int vsiz);
+static int tdbordcmp(int otype, const char *abuf, int asiz, const char *bbuf, int bsiz);
+static VALUE tdbdecode(VALUE vtdb, TCMAP *cols, VALUE vnames);
+static VALUE tdbdecoderun(VALUE vdec);
+static VALUE tdbdecodefree(VALUE vdec);
+static char *tdbbulkpath(TCTDB *tdb);
+static bool tdbbulksave(TCTDB *tdb, const TCLIST *idxs);
+static bool tdbbulkrestore(TCTDB *tdb);
 static void hdb_init(void);
 static VALUE hdb_initialize(VALUE vself);
 static VALUE hdb_errmsg(int argc, VALUE *argv, VALUE vself);
@@ -93,6 +398,7 @@ static VALUE hdb_each_value(VALUE vself);
 static VALUE hdb_keys(VALUE vself);
 static VALUE hdb_values(VALUE vself);
 static void bdb_init(void);
+static void bdb_del(TCBDB *bdb);
 static int bdb_cmpobj(const char *aptr, int asiz, const char *bptr, int bsiz, VALUE vcmp);
 static VALUE bdb_initialize(VALUE vself);
 static VALUE bdb_errmsg(int argc, VALUE *argv, VALUE vself);
@@ -101,6 +407,8 @@ static VALUE bdb_setcmpfunc(VALUE vself, VALUE vcmp);
 static VALUE bdb_tune(int argc, VALUE *argv, VALUE vself);
 static VALUE bdb_setcache(int argc, VALUE *argv, VALUE vself);
 static VALUE bdb_setxmsiz(int argc, VALUE *argv, VALUE vself);
+static VALUE bdb_cacheusage(VALUE vself);
+static VALUE bdb_adjcache(int argc, VALUE *argv, VALUE vself);
 static VALUE bdb_open(int argc, VALUE *argv, VALUE vself);
 static VALUE bdb_close(VALUE vself);
 static VALUE bdb_put(VALUE vself, VALUE vkey, VALUE vval);
@@ -112,9 +420,16 @@ static VALUE bdb_out(VALUE vself, VALUE vkey);
 static VALUE bdb_outlist(VALUE vself, VALUE vkey);
 static VALUE bdb_get(VALUE vself, VALUE vkey);
 static VALUE bdb_getlist(VALUE vself, VALUE vkey);
+static void bdb_sortidx(int *idxs, int *tmp, int num, VALUE vkeys, TCCMP cmp, void *cmpop);
+static VALUE bdb_mgetrun(VALUE vmget);
+static VALUE bdb_mgetfree(VALUE vmget);
+static VALUE bdb_mget_sorted(VALUE vself, VALUE vkeys);
 static VALUE bdb_vnum(VALUE vself, VALUE vkey);
 static VALUE bdb_vsiz(VALUE vself, VALUE vkey);
 static VALUE bdb_range(int argc, VALUE *argv, VALUE vself);
+static VALUE bdb_outrangerun(VALUE vout);
+static VALUE bdb_outrangefree(VALUE vout);
+static VALUE bdb_out_range(int argc, VALUE *argv, VALUE vself);
 static VALUE bdb_fwmkeys(int argc, VALUE *argv, VALUE vself);
 static VALUE bdb_addint(VALUE vself, VALUE vkey, VALUE vnum);
 static VALUE bdb_adddouble(VALUE vself, VALUE vkey, VALUE vnum);
@@ -138,6 +453,18 @@ static VALUE bdb_each_key(VALUE vself);
 static VALUE bdb_each_value(VALUE vself);
 static VALUE bdb_keys(VALUE vself);
 static VALUE bdb_values(VALUE vself);
+static TCLIST *bdb_splitkeys(TCBDB *bdb, const char *bkbuf, int bksiz,
+                             const char *ekbuf, int eksiz, int num);
+static void *bdb_partscan(BDBPART *part);
+static void *bdb_partround(BDBPARTS *parts);
+static VALUE bdb_partyield(VALUE vparts);
+static VALUE bdb_partfree(VALUE vparts);
+static VALUE bdb_parallel_each(int argc, VALUE *argv, VALUE vself);
+static VALUE bdb_poprun(VALUE vpop);
+static VALUE bdb_popfree(VALUE vpop);
+static VALUE bdb_popimpl(int argc, VALUE *argv, VALUE vself, bool last);
+static VALUE bdb_shift(int argc, VALUE *argv, VALUE vself);
+static VALUE bdb_pop(int argc, VALUE *argv, VALUE vself);
 static void bdbcur_init(void);
 static VALUE bdbcur_initialize(VALUE vself, VALUE vbdb);
 static VALUE bdbcur_first(VALUE vself);
@@ -159,12 +486,26 @@ static VALUE fdb_close(VALUE vself);
 static VALUE fdb_put(VALUE vself, VALUE vkey, VALUE vval);
 static VALUE fdb_putkeep(VALUE vself, VALUE vkey, VALUE vval);
 static VALUE fdb_putcat(VALUE vself, VALUE vkey, VALUE vval);
+static VALUE fdb_append_batch(int argc, VALUE *argv, VALUE vself);
 static VALUE fdb_out(VALUE vself, VALUE vkey);
 static VALUE fdb_get(VALUE vself, VALUE vkey);
+static VALUE fdb_put_i64(VALUE vself, VALUE vkey, VALUE vnum);
+static VALUE fdb_get_i64(VALUE vself, VALUE vkey);
+static VALUE fdb_put_f64(VALUE vself, VALUE vkey, VALUE vnum);
+static VALUE fdb_get_f64(VALUE vself, VALUE vkey);
 static VALUE fdb_vsiz(VALUE vself, VALUE vkey);
 static VALUE fdb_iterinit(VALUE vself);
 static VALUE fdb_iternext(VALUE vself);
 static VALUE fdb_range(int argc, VALUE *argv, VALUE vself);
+static VALUE fdb_read_range(int argc, VALUE *argv, VALUE vself);
+static void fdb_interval(TCFDB *fdb, VALUE vinterval, int64_t *lp, int64_t *up);
+static void *fdb_aggscan(FDBAGG *agg);
+static void fdb_aggrun(VALUE vself, VALUE vinterval, VALUE vtype, FDBAGG *agg);
+static VALUE fdb_sum(int argc, VALUE *argv, VALUE vself);
+static VALUE fdb_min(int argc, VALUE *argv, VALUE vself);
+static VALUE fdb_max(int argc, VALUE *argv, VALUE vself);
+static VALUE fdb_mean(int argc, VALUE *argv, VALUE vself);
+static VALUE fdb_histogram(int argc, VALUE *argv, VALUE vself);
 static VALUE fdb_addint(VALUE vself, VALUE vkey, VALUE vnum);
 static VALUE fdb_adddouble(VALUE vself, VALUE vkey, VALUE vnum);
 static VALUE fdb_sync(VALUE vself);
@@ -184,20 +525,46 @@ static VALUE fdb_each_key(VALUE vself);
 static VALUE fdb_each_value(VALUE vself);
 static VALUE fdb_keys(VALUE vself);
 static VALUE fdb_values(VALUE vself);
+static void fdbts_init(void);
+static int64_t fdbts_floordiv(int64_t num, int64_t div);
+static int64_t fdbts_slot(FDBTS *ts, int64_t bucket);
+static VALUE fdbts_initialize(int argc, VALUE *argv, VALUE vself);
+static VALUE fdbts_put(VALUE vself, VALUE vtime, VALUE vval);
+static VALUE fdbts_get(VALUE vself, VALUE vtime);
+static void *fdbts_scan(FDBTSREAD *rd);
+static VALUE fdbts_fetch(int argc, VALUE *argv, VALUE vself);
+static void fdbbm_init(void);
+static int fdbbm_popcount(uint64_t word);
+static int64_t fdbbm_bitnum(VALUE vnum);
+static VALUE fdbbm_initialize(VALUE vself, VALUE vfdb);
+static VALUE fdbbm_update(VALUE vself, VALUE vnum, bool on);
+static VALUE fdbbm_set(VALUE vself, VALUE vnum);
+static VALUE fdbbm_clear(VALUE vself, VALUE vnum);
+static VALUE fdbbm_test(VALUE vself, VALUE vnum);
+static void *fdbbm_countscan(FDBBMOP *op);
+static VALUE fdbbm_count(int argc, VALUE *argv, VALUE vself);
+static void *fdbbm_opscan(FDBBMOP *op);
+static VALUE fdbbm_setop(VALUE vself, VALUE vother, int op);
+static VALUE fdbbm_and(VALUE vself, VALUE vother);
+static VALUE fdbbm_or(VALUE vself, VALUE vother);
+static VALUE fdbbm_andnot(VALUE vself, VALUE vother);
 static void tdb_init(void);
+static void tdb_del(TCTDB *tdb);
 static VALUE tdb_initialize(VALUE vself);
 static VALUE tdb_errmsg(int argc, VALUE *argv, VALUE vself);
 static VALUE tdb_ecode(VALUE vself);
 static VALUE tdb_tune(int argc, VALUE *argv, VALUE vself);
 static VALUE tdb_setcache(int argc, VALUE *argv, VALUE vself);
 static VALUE tdb_setxmsiz(int argc, VALUE *argv, VALUE vself);
+static VALUE tdb_adjcache(int argc, VALUE *argv, VALUE vself);
 static VALUE tdb_open(int argc, VALUE *argv, VALUE vself);
 static VALUE tdb_close(VALUE vself);
 static VALUE tdb_put(VALUE vself, VALUE vkey, VALUE vcols);
 static VALUE tdb_putkeep(VALUE vself, VALUE vkey, VALUE vcols);
 static VALUE tdb_putcat(VALUE vself, VALUE vkey, VALUE vcols);
 static VALUE tdb_out(VALUE vself, VALUE vkey);
-static VALUE tdb_get(VALUE vself, VALUE vkey);
+static VALUE tdb_get(int argc, VALUE *argv, VALUE vself);
+static VALUE tdb_getcol(VALUE vself, VALUE vpkey, VALUE vname);
 static VALUE tdb_vsiz(VALUE vself, VALUE vkey);
 static VALUE tdb_iterinit(VALUE vself);
 static VALUE tdb_iternext(VALUE vself);
@@ -215,6 +582,10 @@ static VALUE tdb_path(VALUE vself);
 static VALUE tdb_rnum(VALUE vself);
 static VALUE tdb_fsiz(VALUE vself);
 static VALUE tdb_setindex(VALUE vself, VALUE vname, VALUE vtype);
+static VALUE tdb_bulkbegin(VALUE vself);
+static void *tdb_bulkbuild(TDBBULK *bulk);
+static VALUE tdb_bulkend(VALUE vself);
+static VALUE tdb_setschema(int argc, VALUE *argv, VALUE vself);
 static VALUE tdb_genuid(VALUE vself);
 static VALUE tdb_fetch(int argc, VALUE *argv, VALUE vself);
 static VALUE tdb_check(VALUE vself, VALUE vkey);
@@ -231,9 +602,54 @@ static VALUE tdbqry_addcond(VALUE vself, VALUE vname, VALUE vop, VALUE vexpr);
 static VALUE tdbqry_setorder(VALUE vself, VALUE vname, VALUE vtype);
 static VALUE tdbqry_setlimit(int argc, VALUE *argv, VALUE vself);
 static VALUE tdbqry_search(VALUE vself);
+static void *tdbqry_fetchrows(TDBROWS *rows);
+static TDBIDX *tdbqry_coveridx(TCTDB *tdb, const char *name);
+static void tdbqry_coverbound(TDBQRYCOVCOL *col, int op, const char *expr);
+static TDBQRYCOVCOL *tdbqry_covercols(VALUE vtpl, VALUE vnames);
+static void *tdbqry_coverscan(TDBQRYCOVER *cov);
+static VALUE tdbqry_rowsrun(VALUE vrows);
+static VALUE tdbqry_rowsfree(VALUE vrows);
+static VALUE tdbqry_searchrows(int argc, VALUE *argv, VALUE vself);
 static VALUE tdbqry_searchout(VALUE vself);
-static VALUE tdbqry_proc(VALUE vself, VALUE vproc);
+static VALUE tdbqry_proc(int argc, VALUE *argv, VALUE vself);
 static VALUE tdbqry_hint(VALUE vself);
+static TDBQRY *tdbqry_native(VALUE vself);
+static TDBQRY *tdbqry_build(TCTDB *tdb, VALUE vtpl, VALUE vbinds);
+static VALUE tdbqry_execute(int argc, VALUE *argv, VALUE vself);
+static VALUE tdbqry_metasearch(int argc, VALUE *argv, VALUE vself);
+static VALUE tdbqry_count(VALUE vself);
+static VALUE tdbqry_exists(VALUE vself);
+static void *tdbqry_aggscan(TDBQRYAGG *agg);
+static VALUE tdbqry_aggregate(VALUE vself, VALUE vgname, VALUE vspecs);
+static VALUE tdbqry_procrun(VALUE vproc);
+static VALUE tdbqry_procend(VALUE vproc);
+static int tdbqry_updrec(const void *pkbuf, int pksiz, TCMAP *cols, TDBQRYUPD *upd);
+static void *tdbqry_updrun(TDBQRYUPD *upd);
+static VALUE tdbqry_update(VALUE vself, VALUE vexprs);
+static void tdbqry_topup(TDBQRYTOPENT *ents, int cur, int otype);
+static void tdbqry_topdown(TDBQRYTOPENT *ents, int num, int cur, int otype);
+static void *tdbqry_toprun(TDBQRYTOP *top);
+static VALUE tdbqry_top(VALUE vself, VALUE vk, VALUE vname, VALUE vtype);
+static void tdbrow_init(void);
+static TDBROW *tdbrow_current(VALUE vself);
+static VALUE tdbrow_get(VALUE vself, VALUE vname);
+static VALUE tdbrow_put(VALUE vself, VALUE vname, VALUE vval);
+static VALUE tdbrow_out(VALUE vself, VALUE vname);
+static VALUE tdbrow_to_hash(VALUE vself);
+static VALUE tdbrow_changed(VALUE vself);
+static void tdbshard_init(void);
+static uint64_t tdbshard_hash(const char *buf, int size);
+static TCTDB *tdbshard_route(VALUE vself, VALUE vpkey);
+static VALUE tdbshard_initialize(VALUE vself, VALUE vtdbs);
+static VALUE tdbshard_shard(VALUE vself, VALUE vpkey);
+static VALUE tdbshard_put(VALUE vself, VALUE vpkey, VALUE vcols);
+static VALUE tdbshard_out(VALUE vself, VALUE vpkey);
+static VALUE tdbshard_get(int argc, VALUE *argv, VALUE vself);
+static VALUE tdbshard_rnum(VALUE vself);
+static void *tdbshard_scan(TDBSHARDSCAN *scan);
+static void *tdbshard_scanall(TDBSHARDRUN *run);
+static int tdbshard_ordcmp(int otype, TDBSHARDSCAN *a, int apos, TDBSHARDSCAN *b, int bpos);
+static VALUE tdbshard_search(int argc, VALUE *argv, VALUE vself);
 
 
 
@@ -252,10 +668,16 @@ VALUE cls_bdbcur_data;
 ID bdb_cmp_call_mid;
 VALUE cls_fdb;
 VALUE cls_fdb_data;
+VALUE cls_fdbts;
+VALUE cls_fdbts_data;
+VALUE cls_fdbbm;
 VALUE cls_tdb;
 VALUE cls_tdb_data;
 VALUE cls_tdbqry;
 VALUE cls_tdbqry_data;
+VALUE cls_tdbrow;
+VALUE cls_tdbrow_data;
+VALUE cls_tdbshard;
 
 
 int Init_tokyocabinet(void){
@@ -265,8 +687,12 @@ int Init_tokyocabinet(void){
   bdb_init();
   bdbcur_init();
   fdb_init();
+  fdbts_init();
+  fdbbm_init();
   tdb_init();
   tdbqry_init();
+  tdbrow_init();
+  tdbshard_init();
   return 0;
 }
 
@@ -277,9 +703,16 @@ int Init_tokyocabinet(void){
  *************************************************************************************************/
 
 
+static TCMAP *cachegrants = NULL;
+static pthread_mutex_t bdbqmutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t bdbqcond = PTHREAD_COND_INITIALIZER;
+static int bdbqwnum = 0;
+
+
 static VALUE StringValueEx(VALUE vobj){
   char kbuf[NUMBUFSIZ];
-  int ksiz;
+  double dnum;
+  int ksiz, prec;
   switch(TYPE(vobj)){
   case T_FIXNUM:
     ksiz = sprintf(kbuf, "%d", (int)FIX2INT(vobj));
@@ -287,6 +720,14 @@ static VALUE StringValueEx(VALUE vobj){
   case T_BIGNUM:
     ksiz = sprintf(kbuf, "%lld", (long long)NUM2LL(vobj));
     return rb_str_new(kbuf, ksiz);
+  case T_FLOAT:
+    dnum = NUM2DBL(vobj);
+    for(prec = DBL_DIG; prec < DBL_DIG + 2; prec++){
+      ksiz = sprintf(kbuf, "%.*g", prec, dnum);
+      if(strtod(kbuf, NULL) == dnum) break;
+    }
+    if(prec >= DBL_DIG + 2) ksiz = sprintf(kbuf, "%.*g", DBL_DIG + 2, dnum);
+    return rb_str_new(kbuf, ksiz);
   case T_TRUE:
     ksiz = sprintf(kbuf, "true");
     return rb_str_new(kbuf, ksiz);
@@ -362,6 +803,315 @@ static VALUE maptovhash(TCMAP *map){
 }
 
 
+static VALUE maptovhash2(TCMAP *map, VALUE vnames){
+  VALUE vhash, vname;
+  const char *vbuf;
+  int i, num, vsiz;
+  if(vnames == Qnil) return maptovhash(map);
+  Check_Type(vnames, T_ARRAY);
+  vhash = rb_hash_new();
+  num = RARRAY_LEN(vnames);
+  for(i = 0; i < num; i++){
+    vname = StringValueEx(rb_ary_entry(vnames, i));
+    if((vbuf = tcmapget(map, RSTRING_PTR(vname), RSTRING_LEN(vname), &vsiz)) != NULL)
+      rb_hash_aset(vhash, vname, rb_str_new(vbuf, vsiz));
+  }
+  return vhash;
+}
+
+
+static int64_t cacheavail(const void *obj, int64_t limit){
+  const char *kbuf, *vbuf;
+  int ksiz, vsiz;
+  int64_t used, size;
+  if(limit < 1) return INT64_MAX;
+  used = 0;
+  if(cachegrants){
+    tcmapiterinit(cachegrants);
+    while((kbuf = tcmapiternext(cachegrants, &ksiz)) != NULL){
+      vbuf = tcmapiterval(kbuf, &vsiz);
+      if(ksiz == sizeof(obj) && !memcmp(kbuf, &obj, sizeof(obj))) continue;
+      memcpy(&size, vbuf, sizeof(size));
+      used += size;
+    }
+  }
+  return (limit > used) ? limit - used : 0;
+}
+
+
+static void cachegrant(const void *obj, int64_t size){
+  if(size > 0){
+    if(!cachegrants) cachegrants = tcmapnew2(31);
+    tcmapput(cachegrants, &obj, sizeof(obj), &size, sizeof(size));
+  } else if(cachegrants){
+    tcmapout(cachegrants, &obj, sizeof(obj));
+  }
+}
+
+
+static int64_t bdbcachepsiz(TCBDB *bdb){
+  int64_t pnum, psiz;
+  pnum = tcbdblnum(bdb) + tcbdbnnum(bdb);
+  psiz = (pnum > 0) ? tcbdbfsiz(bdb) / pnum : 1;
+  return (psiz > 0) ? psiz : 1;
+}
+
+
+static int64_t bdbadjcache(TCBDB *bdb, double ratio, int64_t avail){
+#if defined(HAVE_TC_LAYOUT)
+  int64_t psiz, cnum, lcnum, ncnum;
+  if(!bdb->open) return -1;
+  psiz = bdbcachepsiz(bdb);
+  cnum = avail / psiz;
+  if(cnum < CACHEMINNUM * 2) return -1;
+  ncnum = tcbdbnnum(bdb) * ratio + 1;
+  if(ncnum < CACHEMINNUM) ncnum = CACHEMINNUM;
+  if(ncnum > cnum - CACHEMINNUM) ncnum = cnum - CACHEMINNUM;
+  lcnum = tcbdblnum(bdb) * ratio + 1;
+  if(lcnum < CACHEMINNUM) lcnum = CACHEMINNUM;
+  if(lcnum > cnum - ncnum) lcnum = cnum - ncnum;
+  if(lcnum > INT32_MAX) lcnum = INT32_MAX;
+  if(ncnum > INT32_MAX) ncnum = INT32_MAX;
+  if(bdb->mmtx) pthread_rwlock_wrlock(bdb->mmtx);
+  bdb->lcnum = lcnum;
+  bdb->ncnum = ncnum;
+  if(bdb->mmtx) pthread_rwlock_unlock(bdb->mmtx);
+  return (lcnum + ncnum) * psiz;
+#else
+  return -1;
+#endif
+}
+
+
+static int64_t tdbadjcache(TCTDB *tdb, double ratio, int64_t avail){
+#if defined(HAVE_TC_LAYOUT)
+  int64_t size, rsv, isiz;
+  int i;
+  if(tdb->mmtx) pthread_rwlock_wrlock(tdb->mmtx);
+  if(!tdb->open){
+    if(tdb->mmtx) pthread_rwlock_unlock(tdb->mmtx);
+    return -1;
+  }
+  rsv = 0;
+  for(i = 0; i < tdb->inum; i++){
+    if(tdb->idxs[i].db) rsv += bdbcachepsiz(tdb->idxs[i].db) * CACHEMINNUM * 2;
+  }
+  size = 0;
+  if(rsv <= avail){
+    for(i = 0; i < tdb->inum; i++){
+      if(!tdb->idxs[i].db) continue;
+      rsv -= bdbcachepsiz(tdb->idxs[i].db) * CACHEMINNUM * 2;
+      if((isiz = bdbadjcache(tdb->idxs[i].db, ratio, avail - size - rsv)) > 0) size += isiz;
+    }
+  } else {
+    size = -1;
+  }
+  if(tdb->mmtx) pthread_rwlock_unlock(tdb->mmtx);
+  return size;
+#else
+  return -1;
+#endif
+}
+
+
+static void bdbqnotify(void){
+  if(bdbqwnum < 1) return;
+  pthread_mutex_lock(&bdbqmutex);
+  pthread_cond_broadcast(&bdbqcond);
+  pthread_mutex_unlock(&bdbqmutex);
+}
+
+
+static int64_t bdbsplitnum(int64_t lnum, int64_t hnum, int i, int num){
+  double dnum;
+  dnum = (double)lnum + ((double)hnum - (double)lnum) * i / num;
+  if(dnum <= (double)lnum) return lnum;
+  if(dnum >= (double)hnum) return hnum;
+  return (int64_t)dnum;
+}
+
+
+static int64_t fdbkeytoid(VALUE vkey){
+  if(FIXNUM_P(vkey) || TYPE(vkey) == T_BIGNUM) return NUM2LL(vkey);
+  vkey = StringValueEx(vkey);
+  return tcfdbkeytoid(RSTRING_PTR(vkey), RSTRING_LEN(vkey));
+}
+
+
+static int64_t fdbresolveid(TCFDB *fdb, int64_t id){
+  switch(id){
+  case FDBIDMIN: return tcfdbmin(fdb);
+  case FDBIDPREV: return (int64_t)tcfdbmin(fdb) - 1;
+  case FDBIDMAX: return tcfdbmax(fdb);
+  case FDBIDNEXT: return (int64_t)tcfdbmax(fdb) + 1;
+  }
+  return id;
+}
+
+
+static void *bdbqwait(double *deadline){
+  struct timespec ts;
+  double now, wsec;
+  now = tctime();
+  wsec = (*deadline < 0) ? QWAITSLICE : *deadline - now;
+  if(wsec > QWAITSLICE) wsec = QWAITSLICE;
+  if(wsec <= 0) return NULL;
+  now += wsec;
+  ts.tv_sec = (time_t)now;
+  ts.tv_nsec = (long)((now - ts.tv_sec) * 1000000000.0);
+  pthread_mutex_lock(&bdbqmutex);
+  pthread_cond_timedwait(&bdbqcond, &bdbqmutex, &ts);
+  pthread_mutex_unlock(&bdbqmutex);
+  return NULL;
+}
+
+
+static int tdbcoltype(VALUE vtdb, VALUE vname){
+  VALUE vschema, vsnames, vsname;
+  int i, num;
+  vschema = rb_iv_get(vtdb, TDBVNSCHEMA);
+  if(vschema == Qnil) return TDBCTSTR;
+  vsnames = rb_ary_entry(vschema, 0);
+  num = RARRAY_LEN(vsnames);
+  for(i = 0; i < num; i++){
+    vsname = rb_ary_entry(vsnames, i);
+    if(RSTRING_LEN(vsname) == RSTRING_LEN(vname) &&
+       !memcmp(RSTRING_PTR(vsname), RSTRING_PTR(vname), RSTRING_LEN(vname)))
+      return FIX2INT(rb_ary_entry(rb_ary_entry(vschema, 1), i));
+  }
+  return TDBCTSTR;
+}
+
+
+static VALUE tdbdecodeval(int type, const char *vbuf, int vsiz){
+  switch(type){
+  case TDBCTINT:
+    return LL2NUM(tcatoi(vbuf));
+  case TDBCTFLOAT:
+    return rb_float_new(tcatof(vbuf));
+  case TDBCTBOOL:
+    return (vsiz > 0 && strcmp(vbuf, "0") && strcmp(vbuf, "false")) ? Qtrue : Qfalse;
+  }
+  return rb_str_new(vbuf, vsiz);
+}
+
+
+static int tdbordcmp(int otype, const char *abuf, int asiz, const char *bbuf, int bsiz){
+  double anum, bnum;
+  int rv;
+  switch(otype){
+  case TDBQONUMASC:
+  case TDBQONUMDESC:
+    anum = tcatof(abuf);
+    bnum = tcatof(bbuf);
+    rv = (anum < bnum) ? -1 : (anum > bnum) ? 1 : 0;
+    break;
+  default:
+    rv = memcmp(abuf, bbuf, asiz < bsiz ? asiz : bsiz);
+    if(rv == 0) rv = asiz - bsiz;
+    break;
+  }
+  return (otype == TDBQOSTRDESC || otype == TDBQONUMDESC) ? -rv : rv;
+}
+
+
+static VALUE tdbdecode(VALUE vtdb, TCMAP *cols, VALUE vnames){
+  VALUE vschema, vcls, vhash, vname, vmembers, vargs;
+  const char *kbuf, *vbuf;
+  int i, num, ksiz, vsiz;
+  vschema = rb_iv_get(vtdb, TDBVNSCHEMA);
+  if(vschema == Qnil) return maptovhash2(cols, vnames);
+  vhash = rb_hash_new();
+  if(vnames != Qnil){
+    num = RARRAY_LEN(vnames);
+    for(i = 0; i < num; i++){
+      vname = StringValueEx(rb_ary_entry(vnames, i));
+      if((vbuf = tcmapget(cols, RSTRING_PTR(vname), RSTRING_LEN(vname), &vsiz)) != NULL)
+        rb_hash_aset(vhash, vname, tdbdecodeval(tdbcoltype(vtdb, vname), vbuf, vsiz));
+    }
+  } else {
+    tcmapiterinit(cols);
+    while((kbuf = tcmapiternext(cols, &ksiz)) != NULL){
+      vbuf = tcmapiterval(kbuf, &vsiz);
+      vname = rb_str_new(kbuf, ksiz);
+      rb_hash_aset(vhash, vname, tdbdecodeval(tdbcoltype(vtdb, vname), vbuf, vsiz));
+    }
+  }
+  vcls = rb_ary_entry(vschema, 2);
+  if(vcls == Qnil) return vhash;
+  vmembers = rb_funcall(vcls, rb_intern("members"), 0);
+  num = RARRAY_LEN(vmembers);
+  vargs = rb_ary_new2(num);
+  for(i = 0; i < num; i++){
+    vname = rb_funcall(rb_ary_entry(vmembers, i), rb_intern("to_s"), 0);
+    rb_ary_push(vargs, rb_hash_aref(vhash, vname));
+  }
+  return rb_apply(vcls, rb_intern("new"), vargs);
+}
+
+
+static VALUE tdbdecoderun(VALUE vdec){
+  TDBDECODE *dec;
+  dec = (TDBDECODE *)vdec;
+  return tdbdecode(dec->vtdb, dec->cols, dec->vnames);
+}
+
+
+static VALUE tdbdecodefree(VALUE vdec){
+  TDBDECODE *dec;
+  dec = (TDBDECODE *)vdec;
+  tcmapdel(dec->cols);
+  return Qnil;
+}
+
+
+static char *tdbbulkpath(TCTDB *tdb){
+  const char *path;
+  if(!(path = tctdbpath(tdb))) return NULL;
+  return tcsprintf("%s.bulk", path);
+}
+
+
+static bool tdbbulksave(TCTDB *tdb, const TCLIST *idxs){
+  char *path, *tpath, *buf;
+  int size;
+  bool err;
+  if(!(path = tdbbulkpath(tdb))) return false;
+  tpath = tcsprintf("%s.tmp", path);
+  buf = tclistdump(idxs, &size);
+  err = !tcwritefile(tpath, buf, size) || rename(tpath, path) != 0;
+  if(err) unlink(tpath);
+  tcfree(buf);
+  tcfree(tpath);
+  tcfree(path);
+  return !err;
+}
+
+
+static bool tdbbulkrestore(TCTDB *tdb){
+  TCLIST *idxs;
+  char *path, *buf;
+  int i, num, size;
+  bool err;
+  if(!(path = tdbbulkpath(tdb))) return true;
+  if(!(buf = tcreadfile(path, -1, &size))){
+    tcfree(path);
+    return true;
+  }
+  idxs = tclistload(buf, size);
+  err = false;
+  num = tclistnum(idxs);
+  for(i = 0; i < num - 1; i += 2){
+    if(!tctdbsetindex(tdb, tclistval2(idxs, i), tcatoi(tclistval2(idxs, i + 1)))) err = true;
+  }
+  if(!err) unlink(path);
+  tclistdel(idxs);
+  tcfree(buf);
+  tcfree(path);
+  return !err;
+}
+
+
 static void hdb_init(void){
   cls_hdb = rb_define_class_under(mod_tokyocabinet, "HDB", rb_cObject);
   cls_hdb_data = rb_define_class_under(mod_tokyocabinet, "HDB_data", rb_cObject);
@@ -1034,6 +1784,8 @@ static void bdb_init(void){
   rb_define_method(cls_bdb, "tune", bdb_tune, -1);
   rb_define_method(cls_bdb, "setcache", bdb_setcache, -1);
   rb_define_method(cls_bdb, "setxmsiz", bdb_setxmsiz, -1);
+  rb_define_method(cls_bdb, "cacheusage", bdb_cacheusage, 0);
+  rb_define_method(cls_bdb, "adjcache", bdb_adjcache, -1);
   rb_define_method(cls_bdb, "open", bdb_open, -1);
   rb_define_method(cls_bdb, "close", bdb_close, 0);
   rb_define_method(cls_bdb, "put", bdb_put, 2);
@@ -1045,9 +1797,11 @@ static void bdb_init(void){
   rb_define_method(cls_bdb, "outlist", bdb_outlist, 1);
   rb_define_method(cls_bdb, "get", bdb_get, 1);
   rb_define_method(cls_bdb, "getlist", bdb_getlist, 1);
+  rb_define_method(cls_bdb, "mget_sorted", bdb_mget_sorted, 1);
   rb_define_method(cls_bdb, "vnum", bdb_vnum, 1);
   rb_define_method(cls_bdb, "vsiz", bdb_vsiz, 1);
   rb_define_method(cls_bdb, "range", bdb_range, -1);
+  rb_define_method(cls_bdb, "out_range", bdb_out_range, -1);
   rb_define_method(cls_bdb, "fwmkeys", bdb_fwmkeys, -1);
   rb_define_method(cls_bdb, "addint", bdb_addint, 2);
   rb_define_method(cls_bdb, "adddouble", bdb_adddouble, 2);
@@ -1083,6 +1837,15 @@ static void bdb_init(void){
   rb_define_method(cls_bdb, "each_value", bdb_each_value, 0);
   rb_define_method(cls_bdb, "keys", bdb_keys, 0);
   rb_define_method(cls_bdb, "values", bdb_values, 0);
+  rb_define_method(cls_bdb, "parallel_each", bdb_parallel_each, -1);
+  rb_define_method(cls_bdb, "shift", bdb_shift, -1);
+  rb_define_method(cls_bdb, "pop", bdb_pop, -1);
+}
+
+
+static void bdb_del(TCBDB *bdb){
+  cachegrant(bdb, 0);
+  tcbdbdel(bdb);
 }
 
 
@@ -1098,7 +1861,7 @@ static VALUE bdb_initialize(VALUE vself){
   TCBDB *bdb;
   bdb = tcbdbnew();
   tcbdbsetmutex(bdb);
-  vbdb = Data_Wrap_Struct(cls_bdb_data, 0, tcbdbdel, bdb);
+  vbdb = Data_Wrap_Struct(cls_bdb_data, 0, bdb_del, bdb);
   rb_iv_set(vself, BDBVNDATA, vbdb);
   return Qnil;
 }
@@ -1196,6 +1959,43 @@ static VALUE bdb_setxmsiz(int argc, VALUE *argv, VALUE vself){
 }
 
 
+static VALUE bdb_cacheusage(VALUE vself){
+#if defined(HAVE_TC_LAYOUT)
+  VALUE vbdb, vusage;
+  TCBDB *bdb;
+  vbdb = rb_iv_get(vself, BDBVNDATA);
+  Data_Get_Struct(vbdb, TCBDB, bdb);
+  vusage = rb_hash_new();
+  rb_hash_aset(vusage, rb_str_new2("lcnum"), LL2NUM(bdb->lcnum));
+  rb_hash_aset(vusage, rb_str_new2("ncnum"), LL2NUM(bdb->ncnum));
+  rb_hash_aset(vusage, rb_str_new2("lcache"), LL2NUM(bdb->leafc ? tcmaprnum(bdb->leafc) : 0));
+  rb_hash_aset(vusage, rb_str_new2("ncache"), LL2NUM(bdb->nodec ? tcmaprnum(bdb->nodec) : 0));
+  rb_hash_aset(vusage, rb_str_new2("lnum"), LL2NUM(tcbdblnum(bdb)));
+  rb_hash_aset(vusage, rb_str_new2("nnum"), LL2NUM(tcbdbnnum(bdb)));
+  return vusage;
+#else
+  return Qnil;
+#endif
+}
+
+
+static VALUE bdb_adjcache(int argc, VALUE *argv, VALUE vself){
+  VALUE vbdb, vratio, vlimit;
+  TCBDB *bdb;
+  double ratio;
+  int64_t limit, size;
+  rb_scan_args(argc, argv, "11", &vratio, &vlimit);
+  ratio = NUM2DBL(vratio);
+  limit = (vlimit == Qnil) ? -1 : NUM2LL(vlimit);
+  vbdb = rb_iv_get(vself, BDBVNDATA);
+  Data_Get_Struct(vbdb, TCBDB, bdb);
+  if(ratio < 0) return Qfalse;
+  if((size = bdbadjcache(bdb, ratio, cacheavail(bdb, limit))) < 0) return Qfalse;
+  cachegrant(bdb, size);
+  return Qtrue;
+}
+
+
 static VALUE bdb_open(int argc, VALUE *argv, VALUE vself){
   VALUE vbdb, vpath, vomode;
   TCBDB *bdb;
@@ -1214,6 +2014,7 @@ static VALUE bdb_close(VALUE vself){
   TCBDB *bdb;
   vbdb = rb_iv_get(vself, BDBVNDATA);
   Data_Get_Struct(vbdb, TCBDB, bdb);
+  cachegrant(bdb, 0);
   return tcbdbclose(bdb) ? Qtrue : Qfalse;
 }
 
@@ -1225,8 +2026,10 @@ static VALUE bdb_put(VALUE vself, VALUE vkey, VALUE vval){
   vval = StringValueEx(vval);
   vbdb = rb_iv_get(vself, BDBVNDATA);
   Data_Get_Struct(vbdb, TCBDB, bdb);
-  return tcbdbput(bdb, RSTRING_PTR(vkey), RSTRING_LEN(vkey), RSTRING_PTR(vval),
-		  RSTRING_LEN(vval)) ? Qtrue : Qfalse;
+  if(!tcbdbput(bdb, RSTRING_PTR(vkey), RSTRING_LEN(vkey), RSTRING_PTR(vval), RSTRING_LEN(vval)))
+    return Qfalse;
+  bdbqnotify();
+  return Qtrue;
 }
 
 
@@ -1237,8 +2040,10 @@ static VALUE bdb_putkeep(VALUE vself, VALUE vkey, VALUE vval){
   vval = StringValueEx(vval);
   vbdb = rb_iv_get(vself, BDBVNDATA);
   Data_Get_Struct(vbdb, TCBDB, bdb);
-  return tcbdbputkeep(bdb, RSTRING_PTR(vkey), RSTRING_LEN(vkey), RSTRING_PTR(vval),
-		      RSTRING_LEN(vval)) ? Qtrue : Qfalse;
+  if(!tcbdbputkeep(bdb, RSTRING_PTR(vkey), RSTRING_LEN(vkey), RSTRING_PTR(vval), RSTRING_LEN(vval)))
+    return Qfalse;
+  bdbqnotify();
+  return Qtrue;
 }
 
 
@@ -1249,8 +2054,10 @@ static VALUE bdb_putcat(VALUE vself, VALUE vkey, VALUE vval){
   vval = StringValueEx(vval);
   vbdb = rb_iv_get(vself, BDBVNDATA);
   Data_Get_Struct(vbdb, TCBDB, bdb);
-  return tcbdbputcat(bdb, RSTRING_PTR(vkey), RSTRING_LEN(vkey), RSTRING_PTR(vval),
-		     RSTRING_LEN(vval)) ? Qtrue : Qfalse;
+  if(!tcbdbputcat(bdb, RSTRING_PTR(vkey), RSTRING_LEN(vkey), RSTRING_PTR(vval), RSTRING_LEN(vval)))
+    return Qfalse;
+  bdbqnotify();
+  return Qtrue;
 }
 
 
@@ -1261,8 +2068,10 @@ static VALUE bdb_putdup(VALUE vself, VALUE vkey, VALUE vval){
   vval = StringValueEx(vval);
   vbdb = rb_iv_get(vself, BDBVNDATA);
   Data_Get_Struct(vbdb, TCBDB, bdb);
-  return tcbdbputdup(bdb, RSTRING_PTR(vkey), RSTRING_LEN(vkey), RSTRING_PTR(vval),
-		     RSTRING_LEN(vval)) ? Qtrue : Qfalse;
+  if(!tcbdbputdup(bdb, RSTRING_PTR(vkey), RSTRING_LEN(vkey), RSTRING_PTR(vval), RSTRING_LEN(vval)))
+    return Qfalse;
+  bdbqnotify();
+  return Qtrue;
 }
 
 
@@ -1279,7 +2088,9 @@ static VALUE bdb_putlist(VALUE vself, VALUE vkey, VALUE vvals){
   err = false;
   if(!tcbdbputdup3(bdb, RSTRING_PTR(vkey), RSTRING_LEN(vkey), tvals)) err = true;
   tclistdel(tvals);
-  return err ? Qfalse : Qtrue;
+  if(err) return Qfalse;
+  bdbqnotify();
+  return Qtrue;
 }
 
 
@@ -1330,6 +2141,120 @@ static VALUE bdb_getlist(VALUE vself, VALUE vkey){
 }
 
 
+static void bdb_sortidx(int *idxs, int *tmp, int num, VALUE vkeys, TCCMP cmp, void *cmpop){
+  VALUE va, vb;
+  int i, j, k, mid;
+  if(num < 2) return;
+  mid = num / 2;
+  bdb_sortidx(idxs, tmp, mid, vkeys, cmp, cmpop);
+  bdb_sortidx(idxs + mid, tmp, num - mid, vkeys, cmp, cmpop);
+  i = 0;
+  j = mid;
+  k = 0;
+  while(i < mid && j < num){
+    va = rb_ary_entry(vkeys, idxs[i]);
+    vb = rb_ary_entry(vkeys, idxs[j]);
+    if(cmp(RSTRING_PTR(vb), RSTRING_LEN(vb), RSTRING_PTR(va), RSTRING_LEN(va), cmpop) < 0){
+      tmp[k++] = idxs[j++];
+    } else {
+      tmp[k++] = idxs[i++];
+    }
+  }
+  while(i < mid){
+    tmp[k++] = idxs[i++];
+  }
+  while(j < num){
+    tmp[k++] = idxs[j++];
+  }
+  memcpy(idxs, tmp, sizeof(*idxs) * num);
+}
+
+
+static VALUE bdb_mgetrun(VALUE vmget){
+  BDBMGET *mget;
+  VALUE vkey, vval;
+  TCCMP cmp;
+  void *cmpop;
+  const char *kbuf, *ckbuf, *vbuf, *pkbuf;
+  int i, j, ksiz, cksiz, vsiz, pksiz;
+  bool valid, pos;
+  mget = (BDBMGET *)vmget;
+  cmp = tcbdbcmpfunc(mget->bdb);
+  cmpop = tcbdbcmpop(mget->bdb);
+  for(i = 0; i < mget->num; i++){
+    mget->idxs[i] = i;
+  }
+  bdb_sortidx(mget->idxs, mget->idxs + mget->num, mget->num, mget->vstrs, cmp, cmpop);
+  mget->cur = tcbdbcurnew(mget->bdb);
+  vval = Qnil;
+  pkbuf = NULL;
+  pksiz = 0;
+  valid = false;
+  for(i = 0; i < mget->num; i++){
+    vkey = rb_ary_entry(mget->vstrs, mget->idxs[i]);
+    kbuf = RSTRING_PTR(vkey);
+    ksiz = RSTRING_LEN(vkey);
+    if(pkbuf && cmp(kbuf, ksiz, pkbuf, pksiz, cmpop) == 0){
+      rb_ary_store(mget->vary, mget->idxs[i], (vval != Qnil) ? rb_str_dup(vval) : Qnil);
+      continue;
+    }
+    pos = false;
+    if(valid){
+      for(j = 0; j <= MGETSTEPNUM; j++){
+        ckbuf = tcbdbcurkey3(mget->cur, &cksiz);
+        if(!ckbuf || cmp(ckbuf, cksiz, kbuf, ksiz, cmpop) >= 0){
+          pos = true;
+          break;
+        }
+        tcbdbcurnext(mget->cur);
+      }
+    }
+    if(!pos){
+      tcbdbcurjump(mget->cur, kbuf, ksiz);
+      valid = true;
+    }
+    vval = Qnil;
+    ckbuf = tcbdbcurkey3(mget->cur, &cksiz);
+    if(ckbuf && cmp(ckbuf, cksiz, kbuf, ksiz, cmpop) == 0 &&
+       (vbuf = tcbdbcurval3(mget->cur, &vsiz)) != NULL) vval = rb_str_new(vbuf, vsiz);
+    rb_ary_store(mget->vary, mget->idxs[i], vval);
+    pkbuf = kbuf;
+    pksiz = ksiz;
+  }
+  return mget->vary;
+}
+
+
+static VALUE bdb_mgetfree(VALUE vmget){
+  BDBMGET *mget;
+  mget = (BDBMGET *)vmget;
+  if(mget->cur) tcbdbcurdel(mget->cur);
+  tcfree(mget->idxs);
+  return Qnil;
+}
+
+
+static VALUE bdb_mget_sorted(VALUE vself, VALUE vkeys){
+  VALUE vbdb, vstrs;
+  BDBMGET mget;
+  int i, num;
+  Check_Type(vkeys, T_ARRAY);
+  num = RARRAY_LEN(vkeys);
+  vstrs = rb_ary_new2(num);
+  for(i = 0; i < num; i++){
+    rb_ary_push(vstrs, StringValueEx(rb_ary_entry(vkeys, i)));
+  }
+  vbdb = rb_iv_get(vself, BDBVNDATA);
+  Data_Get_Struct(vbdb, TCBDB, mget.bdb);
+  mget.cur = NULL;
+  mget.vstrs = vstrs;
+  mget.vary = rb_ary_new2(num);
+  mget.num = num;
+  mget.idxs = tcmalloc(sizeof(*mget.idxs) * (num * 2 + 1));
+  return rb_ensure(bdb_mgetrun, (VALUE)&mget, bdb_mgetfree, (VALUE)&mget);
+}
+
+
 static VALUE bdb_vnum(VALUE vself, VALUE vkey){
   VALUE vbdb;
   TCBDB *bdb;
@@ -1386,6 +2311,89 @@ static VALUE bdb_range(int argc, VALUE *argv, VALUE vself){
 }
 
 
+static VALUE bdb_outrangerun(VALUE vout){
+  BDBOUT *out;
+  TCCMP cmp;
+  void *cmpop;
+  const char *kbuf;
+  int ksiz, rv;
+  out = (BDBOUT *)vout;
+  cmp = tcbdbcmpfunc(out->bdb);
+  cmpop = tcbdbcmpop(out->bdb);
+  out->cur = tcbdbcurnew(out->bdb);
+  if(out->bkbuf){
+    tcbdbcurjump(out->cur, out->bkbuf, out->bksiz);
+    if(!out->binc){
+      while((kbuf = tcbdbcurkey3(out->cur, &ksiz)) != NULL &&
+            cmp(kbuf, ksiz, out->bkbuf, out->bksiz, cmpop) == 0){
+        tcbdbcurnext(out->cur);
+      }
+    }
+  } else {
+    tcbdbcurfirst(out->cur);
+  }
+  while((kbuf = tcbdbcurkey3(out->cur, &ksiz)) != NULL){
+    if(out->ekbuf){
+      rv = cmp(kbuf, ksiz, out->ekbuf, out->eksiz, cmpop);
+      if(rv > 0 || (rv == 0 && !out->einc)) break;
+    }
+    if(!tcbdbcurout(out->cur)) return Qnil;
+    out->num++;
+  }
+  out->done = true;
+  return Qnil;
+}
+
+
+static VALUE bdb_outrangefree(VALUE vout){
+  BDBOUT *out;
+  out = (BDBOUT *)vout;
+  if(out->cur) tcbdbcurdel(out->cur);
+  if(out->tran){
+    if(!out->done){
+      tcbdbtranabort(out->bdb);
+    } else if(!tcbdbtrancommit(out->bdb)){
+      out->done = false;
+    }
+  }
+  return Qnil;
+}
+
+
+static VALUE bdb_out_range(int argc, VALUE *argv, VALUE vself){
+  VALUE vbdb, vbkey, vbinc, vekey, veinc, vtran;
+  BDBOUT out;
+  rb_scan_args(argc, argv, "05", &vbkey, &vbinc, &vekey, &veinc, &vtran);
+  if(vbkey != Qnil) vbkey = StringValueEx(vbkey);
+  if(vekey != Qnil) vekey = StringValueEx(vekey);
+  out.binc = (vbinc != Qnil && vbinc != Qfalse);
+  out.einc = (veinc != Qnil && veinc != Qfalse);
+  out.tran = (vtran != Qnil && vtran != Qfalse);
+  vbdb = rb_iv_get(vself, BDBVNDATA);
+  Data_Get_Struct(vbdb, TCBDB, out.bdb);
+  if(vbkey != Qnil){
+    out.bkbuf = RSTRING_PTR(vbkey);
+    out.bksiz = RSTRING_LEN(vbkey);
+  } else {
+    out.bkbuf = NULL;
+    out.bksiz = -1;
+  }
+  if(vekey != Qnil){
+    out.ekbuf = RSTRING_PTR(vekey);
+    out.eksiz = RSTRING_LEN(vekey);
+  } else {
+    out.ekbuf = NULL;
+    out.eksiz = -1;
+  }
+  if(out.tran && !tcbdbtranbegin(out.bdb)) return Qnil;
+  out.cur = NULL;
+  out.num = 0;
+  out.done = false;
+  rb_ensure(bdb_outrangerun, (VALUE)&out, bdb_outrangefree, (VALUE)&out);
+  return out.done ? LL2NUM(out.num) : Qnil;
+}
+
+
 static VALUE bdb_fwmkeys(int argc, VALUE *argv, VALUE vself){
   VALUE vbdb, vprefix, vmax, vary;
   TCBDB *bdb;
@@ -1723,64 +2731,415 @@ static VALUE bdb_values(VALUE vself){
 }
 
 
-static void bdbcur_init(void){
-  cls_bdbcur = rb_define_class_under(mod_tokyocabinet, "BDBCUR", rb_cObject);
-  cls_bdbcur_data = rb_define_class_under(mod_tokyocabinet, "BDBCUR_data", rb_cObject);
-  rb_define_const(cls_bdbcur, "CPCURRENT", INT2NUM(BDBCPCURRENT));
-  rb_define_const(cls_bdbcur, "CPBEFORE", INT2NUM(BDBCPBEFORE));
-  rb_define_const(cls_bdbcur, "CPAFTER", INT2NUM(BDBCPAFTER));
-  rb_define_private_method(cls_bdbcur, "initialize", bdbcur_initialize, 1);
-  rb_define_method(cls_bdbcur, "first", bdbcur_first, 0);
-  rb_define_method(cls_bdbcur, "last", bdbcur_last, 0);
-  rb_define_method(cls_bdbcur, "jump", bdbcur_jump, 1);
-  rb_define_method(cls_bdbcur, "prev", bdbcur_prev, 0);
-  rb_define_method(cls_bdbcur, "next", bdbcur_next, 0);
-  rb_define_method(cls_bdbcur, "put", bdbcur_put, -1);
-  rb_define_method(cls_bdbcur, "out", bdbcur_out, 0);
-  rb_define_method(cls_bdbcur, "key", bdbcur_key, 0);
-  rb_define_method(cls_bdbcur, "val", bdbcur_val, 0);
-}
-
-
-static VALUE bdbcur_initialize(VALUE vself, VALUE vbdb){
-  VALUE vcur;
-  TCBDB *bdb;
+static TCLIST *bdb_splitkeys(TCBDB *bdb, const char *bkbuf, int bksiz,
+                             const char *ekbuf, int eksiz, int num){
+  TCLIST *keys;
+  TCCMP cmp;
+  void *cmpop;
   BDBCUR *cur;
-  Check_Type(vbdb, T_OBJECT);
-  vbdb = rb_iv_get(vbdb, BDBVNDATA);
-  Data_Get_Struct(vbdb, TCBDB, bdb);
+  char *lkbuf, *hkbuf, *kbuf, sbuf[NUMBUFSIZ];
+  const char *pkbuf;
+  int i, lksiz, hksiz, ksiz, pksiz, ssiz, plen, j;
+  uint64_t la, hb;
+  int64_t li, hi;
+  int32_t si;
+  keys = tclistnew2(num);
+  cmp = tcbdbcmpfunc(bdb);
+  cmpop = tcbdbcmpop(bdb);
   cur = tcbdbcurnew(bdb);
-  vcur = Data_Wrap_Struct(cls_bdbcur_data, 0, tcbdbcurdel, cur);
-  rb_iv_set(vself, BDBCURVNDATA, vcur);
-  rb_iv_set(vself, BDBVNDATA, vbdb);
-  return Qnil;
+  if(bkbuf){
+    tcbdbcurjump(cur, bkbuf, bksiz);
+  } else {
+    tcbdbcurfirst(cur);
+  }
+  lkbuf = tcbdbcurkey(cur, &lksiz);
+  if(ekbuf){
+    hkbuf = tcmemdup(ekbuf, eksiz);
+    hksiz = eksiz;
+  } else {
+    tcbdbcurlast(cur);
+    hkbuf = tcbdbcurkey(cur, &hksiz);
+  }
+  if(!lkbuf || !hkbuf || cmp(lkbuf, lksiz, hkbuf, hksiz, cmpop) >= 0) num = 1;
+  for(i = 1; i < num; i++){
+    ssiz = -1;
+    if(cmp == tccmpdecimal){
+      li = tcatoi(lkbuf);
+      hi = tcatoi(hkbuf);
+      ssiz = sprintf(sbuf, "%lld", (long long)bdbsplitnum(li, hi, i, num));
+    } else if(cmp == tccmpint32 && lksiz == sizeof(si) && hksiz == sizeof(si)){
+      memcpy(&si, lkbuf, sizeof(si));
+      li = si;
+      memcpy(&si, hkbuf, sizeof(si));
+      hi = si;
+      si = bdbsplitnum(li, hi, i, num);
+      memcpy(sbuf, &si, sizeof(si));
+      ssiz = sizeof(si);
+    } else if(cmp == tccmpint64 && lksiz == sizeof(li) && hksiz == sizeof(hi)){
+      memcpy(&li, lkbuf, sizeof(li));
+      memcpy(&hi, hkbuf, sizeof(hi));
+      li = bdbsplitnum(li, hi, i, num);
+      memcpy(sbuf, &li, sizeof(li));
+      ssiz = sizeof(li);
+    } else if(cmp == tccmplexical){
+      for(plen = 0; plen < lksiz && plen < hksiz && lkbuf[plen] == hkbuf[plen]; plen++);
+      if(plen > NUMBUFSIZ - 6) break;
+      la = 0;
+      hb = 0;
+      for(j = 0; j < 6; j++){
+        la = (la << 8) + ((plen + j < lksiz) ? ((unsigned char *)lkbuf)[plen+j] : 0);
+        hb = (hb << 8) + ((plen + j < hksiz) ? ((unsigned char *)hkbuf)[plen+j] : 0);
+      }
+      la = la + (hb - la) * i / num;
+      memcpy(sbuf, lkbuf, plen);
+      for(j = 5; j >= 0; j--){
+        sbuf[plen+j] = la & 0xff;
+        la >>= 8;
+      }
+      ssiz = plen + 6;
+    }
+    if(ssiz < 0 || !tcbdbcurjump(cur, sbuf, ssiz)) break;
+    if(!(kbuf = tcbdbcurkey(cur, &ksiz))) break;
+    if(cmp(kbuf, ksiz, hkbuf, hksiz, cmpop) > 0){
+      tcfree(kbuf);
+      break;
+    }
+    if(tclistnum(keys) > 0){
+      pkbuf = tclistval(keys, tclistnum(keys) - 1, &pksiz);
+    } else {
+      pkbuf = lkbuf;
+      pksiz = lksiz;
+    }
+    if(cmp(kbuf, ksiz, pkbuf, pksiz, cmpop) > 0) tclistpush(keys, kbuf, ksiz);
+    tcfree(kbuf);
+  }
+  tcfree(hkbuf);
+  tcfree(lkbuf);
+  tcbdbcurdel(cur);
+  return keys;
 }
 
 
-static VALUE bdbcur_first(VALUE vself){
-  VALUE vcur;
-  BDBCUR *cur;
-  vcur = rb_iv_get(vself, BDBCURVNDATA);
-  Data_Get_Struct(vcur, BDBCUR, cur);
-  return tcbdbcurfirst(cur) ? Qtrue : Qfalse;
+static void *bdb_partscan(BDBPART *part){
+  TCCMP cmp;
+  void *cmpop;
+  TCXSTR *kxstr, *vxstr;
+  int rv;
+  cmp = tcbdbcmpfunc(part->bdb);
+  cmpop = tcbdbcmpop(part->bdb);
+  kxstr = tcxstrnew();
+  vxstr = tcxstrnew();
+  tclistclear(part->recs);
+  while(tclistnum(part->recs) < PARTRECNUM * 2){
+    if(!tcbdbcurrec(part->cur, kxstr, vxstr)){
+      part->done = true;
+      break;
+    }
+    if(part->ekbuf){
+      rv = cmp(tcxstrptr(kxstr), tcxstrsize(kxstr), part->ekbuf, part->eksiz, cmpop);
+      if(rv > 0 || (rv == 0 && !part->einc)){
+        part->done = true;
+        break;
+      }
+    }
+    tclistpush(part->recs, tcxstrptr(kxstr), tcxstrsize(kxstr));
+    tclistpush(part->recs, tcxstrptr(vxstr), tcxstrsize(vxstr));
+    tcbdbcurnext(part->cur);
+  }
+  tcxstrdel(vxstr);
+  tcxstrdel(kxstr);
+  return NULL;
 }
 
 
-static VALUE bdbcur_last(VALUE vself){
-  VALUE vcur;
-  BDBCUR *cur;
-  vcur = rb_iv_get(vself, BDBCURVNDATA);
-  Data_Get_Struct(vcur, BDBCUR, cur);
-  return tcbdbcurlast(cur) ? Qtrue : Qfalse;
+static void *bdb_partround(BDBPARTS *parts){
+  BDBPART *part;
+  int i;
+  for(i = 0; i < parts->pnum; i++){
+    part = parts->parts + i;
+    part->live = false;
+    if(part->done){
+      tclistclear(part->recs);
+    } else if(parts->pnum > 1 &&
+              pthread_create(&part->th, NULL, (void *(*)(void *))bdb_partscan, part) == 0){
+      part->live = true;
+    } else {
+      bdb_partscan(part);
+    }
+  }
+  for(i = 0; i < parts->pnum; i++){
+    part = parts->parts + i;
+    if(part->live) pthread_join(part->th, NULL);
+    part->live = false;
+  }
+  return NULL;
 }
 
 
-static VALUE bdbcur_jump(VALUE vself, VALUE vkey){
-  VALUE vcur;
-  BDBCUR *cur;
-  vkey = StringValueEx(vkey);
-  vcur = rb_iv_get(vself, BDBCURVNDATA);
-  Data_Get_Struct(vcur, BDBCUR, cur);
+static VALUE bdb_partyield(VALUE vparts){
+  VALUE vrv;
+  BDBPARTS *parts;
+  BDBPART *part;
+  const char *kbuf, *vbuf;
+  int i, j, num, ksiz, vsiz;
+  bool busy;
+  parts = (BDBPARTS *)vparts;
+  vrv = Qnil;
+  do {
+    if(parts->nogvl){
+      NOGVLCALL(bdb_partround, parts);
+    } else {
+      bdb_partround(parts);
+    }
+    busy = false;
+    for(i = 0; i < parts->pnum; i++){
+      part = parts->parts + i;
+      num = tclistnum(part->recs);
+      for(j = 0; j < num - 1; j += 2){
+        kbuf = tclistval(part->recs, j, &ksiz);
+        vbuf = tclistval(part->recs, j + 1, &vsiz);
+        vrv = rb_yield_values(2, rb_str_new(kbuf, ksiz), rb_str_new(vbuf, vsiz));
+      }
+      if(!part->done) busy = true;
+    }
+  } while(busy);
+  return vrv;
+}
+
+
+static VALUE bdb_partfree(VALUE vparts){
+  BDBPARTS *parts;
+  BDBPART *part;
+  int i;
+  parts = (BDBPARTS *)vparts;
+  for(i = 0; i < parts->pnum; i++){
+    part = parts->parts + i;
+    tclistdel(part->recs);
+    tcfree(part->ekbuf);
+    tcbdbcurdel(part->cur);
+  }
+  tcfree(parts->parts);
+  return Qnil;
+}
+
+
+static VALUE bdb_parallel_each(int argc, VALUE *argv, VALUE vself){
+  VALUE vbdb, vbkey, vekey, vtnum;
+  TCBDB *bdb;
+  TCCMP cmp;
+  TCLIST *keys;
+  BDBPARTS parts;
+  BDBPART *part;
+  const char *bkbuf, *ekbuf, *kbuf;
+  int i, bksiz, eksiz, ksiz, tnum;
+  rb_scan_args(argc, argv, "03", &vbkey, &vekey, &vtnum);
+  if(rb_block_given_p() != Qtrue) rb_raise(rb_eArgError, "no block given");
+  if(vbkey != Qnil) vbkey = StringValueEx(vbkey);
+  if(vekey != Qnil) vekey = StringValueEx(vekey);
+  tnum = (vtnum == Qnil) ? 1 : NUM2INT(vtnum);
+  if(tnum < 1) tnum = 1;
+  if(tnum > PARTMAXNUM) tnum = PARTMAXNUM;
+  vbdb = rb_iv_get(vself, BDBVNDATA);
+  Data_Get_Struct(vbdb, TCBDB, bdb);
+  if(vbkey != Qnil){
+    bkbuf = RSTRING_PTR(vbkey);
+    bksiz = RSTRING_LEN(vbkey);
+  } else {
+    bkbuf = NULL;
+    bksiz = -1;
+  }
+  if(vekey != Qnil){
+    ekbuf = RSTRING_PTR(vekey);
+    eksiz = RSTRING_LEN(vekey);
+  } else {
+    ekbuf = NULL;
+    eksiz = -1;
+  }
+  cmp = tcbdbcmpfunc(bdb);
+  parts.nogvl = cmp == tccmplexical || cmp == tccmpdecimal ||
+                cmp == tccmpint32 || cmp == tccmpint64;
+  keys = parts.nogvl ? bdb_splitkeys(bdb, bkbuf, bksiz, ekbuf, eksiz, tnum) : tclistnew();
+  parts.pnum = tclistnum(keys) + 1;
+  parts.parts = tcmalloc(sizeof(*parts.parts) * parts.pnum);
+  for(i = 0; i < parts.pnum; i++){
+    part = parts.parts + i;
+    part->bdb = bdb;
+    part->cur = tcbdbcurnew(bdb);
+    part->recs = tclistnew2(PARTRECNUM * 2);
+    part->done = false;
+    part->live = false;
+    if(i > 0){
+      kbuf = tclistval(keys, i - 1, &ksiz);
+      tcbdbcurjump(part->cur, kbuf, ksiz);
+    } else if(bkbuf){
+      tcbdbcurjump(part->cur, bkbuf, bksiz);
+    } else {
+      tcbdbcurfirst(part->cur);
+    }
+    if(i < parts.pnum - 1){
+      kbuf = tclistval(keys, i, &ksiz);
+      part->ekbuf = tcmemdup(kbuf, ksiz);
+      part->eksiz = ksiz;
+      part->einc = false;
+    } else if(ekbuf){
+      part->ekbuf = tcmemdup(ekbuf, eksiz);
+      part->eksiz = eksiz;
+      part->einc = true;
+    } else {
+      part->ekbuf = NULL;
+      part->eksiz = 0;
+      part->einc = false;
+    }
+  }
+  tclistdel(keys);
+  return rb_ensure(bdb_partyield, (VALUE)&parts, bdb_partfree, (VALUE)&parts);
+}
+
+
+static VALUE bdb_poprun(VALUE vpop){
+  BDBPOP *pop;
+#if !defined(HAVE_RB_THREAD_CALL_WITHOUT_GVL)
+  struct timeval tv;
+#endif
+  pop = (BDBPOP *)vpop;
+  while(true){
+    pop->cur = tcbdbcurnew(pop->bdb);
+    while(RARRAY_LEN(pop->vary) < pop->num &&
+          (pop->last ? tcbdbcurlast(pop->cur) : tcbdbcurfirst(pop->cur)) &&
+          tcbdbcurrec(pop->cur, pop->kxstr, pop->vxstr) && tcbdbcurout(pop->cur)){
+      rb_ary_push(pop->vary,
+                  rb_ary_new3(2, rb_str_new(tcxstrptr(pop->kxstr), tcxstrsize(pop->kxstr)),
+                              rb_str_new(tcxstrptr(pop->vxstr), tcxstrsize(pop->vxstr))));
+    }
+    tcbdbcurdel(pop->cur);
+    pop->cur = NULL;
+    if(RARRAY_LEN(pop->vary) > 0 || pop->num < 1 || !pop->wait ||
+       (pop->deadline >= 0 && tctime() >= pop->deadline)) break;
+    pop->waiting = true;
+    bdbqwnum++;
+#if defined(HAVE_RB_THREAD_CALL_WITHOUT_GVL)
+    NOGVLCALL(bdbqwait, &pop->deadline);
+#else
+    tv.tv_sec = 0;
+    tv.tv_usec = QWAITSLICE * 1000000;
+    rb_thread_wait_for(tv);
+#endif
+    bdbqwnum--;
+    pop->waiting = false;
+  }
+  return pop->vary;
+}
+
+
+static VALUE bdb_popfree(VALUE vpop){
+  BDBPOP *pop;
+  pop = (BDBPOP *)vpop;
+  if(pop->waiting) bdbqwnum--;
+  if(pop->cur) tcbdbcurdel(pop->cur);
+  tcxstrdel(pop->vxstr);
+  tcxstrdel(pop->kxstr);
+  return Qnil;
+}
+
+
+static VALUE bdb_popimpl(int argc, VALUE *argv, VALUE vself, bool last){
+  VALUE vbdb, vnum, vtimeout, vary;
+  BDBPOP pop;
+  double deadline;
+  int num;
+  rb_scan_args(argc, argv, "02", &vnum, &vtimeout);
+  num = (vnum == Qnil) ? 1 : NUM2INT(vnum);
+  deadline = 0;
+  if(vtimeout != Qnil){
+    deadline = NUM2DBL(vtimeout);
+    deadline = (deadline < 0) ? -1 : tctime() + deadline;
+  }
+  vbdb = rb_iv_get(vself, BDBVNDATA);
+  Data_Get_Struct(vbdb, TCBDB, pop.bdb);
+  vary = rb_ary_new();
+  pop.cur = NULL;
+  pop.vary = vary;
+  pop.num = num;
+  pop.last = last;
+  pop.wait = vtimeout != Qnil;
+  pop.deadline = deadline;
+  pop.waiting = false;
+  pop.kxstr = tcxstrnew();
+  pop.vxstr = tcxstrnew();
+  rb_ensure(bdb_poprun, (VALUE)&pop, bdb_popfree, (VALUE)&pop);
+  if(vnum == Qnil) return RARRAY_LEN(vary) > 0 ? rb_ary_entry(vary, 0) : Qnil;
+  return vary;
+}
+
+
+static VALUE bdb_shift(int argc, VALUE *argv, VALUE vself){
+  return bdb_popimpl(argc, argv, vself, false);
+}
+
+
+static VALUE bdb_pop(int argc, VALUE *argv, VALUE vself){
+  return bdb_popimpl(argc, argv, vself, true);
+}
+
+
+static void bdbcur_init(void){
+  cls_bdbcur = rb_define_class_under(mod_tokyocabinet, "BDBCUR", rb_cObject);
+  cls_bdbcur_data = rb_define_class_under(mod_tokyocabinet, "BDBCUR_data", rb_cObject);
+  rb_define_const(cls_bdbcur, "CPCURRENT", INT2NUM(BDBCPCURRENT));
+  rb_define_const(cls_bdbcur, "CPBEFORE", INT2NUM(BDBCPBEFORE));
+  rb_define_const(cls_bdbcur, "CPAFTER", INT2NUM(BDBCPAFTER));
+  rb_define_private_method(cls_bdbcur, "initialize", bdbcur_initialize, 1);
+  rb_define_method(cls_bdbcur, "first", bdbcur_first, 0);
+  rb_define_method(cls_bdbcur, "last", bdbcur_last, 0);
+  rb_define_method(cls_bdbcur, "jump", bdbcur_jump, 1);
+  rb_define_method(cls_bdbcur, "prev", bdbcur_prev, 0);
+  rb_define_method(cls_bdbcur, "next", bdbcur_next, 0);
+  rb_define_method(cls_bdbcur, "put", bdbcur_put, -1);
+  rb_define_method(cls_bdbcur, "out", bdbcur_out, 0);
+  rb_define_method(cls_bdbcur, "key", bdbcur_key, 0);
+  rb_define_method(cls_bdbcur, "val", bdbcur_val, 0);
+}
+
+
+static VALUE bdbcur_initialize(VALUE vself, VALUE vbdb){
+  VALUE vcur;
+  TCBDB *bdb;
+  BDBCUR *cur;
+  Check_Type(vbdb, T_OBJECT);
+  vbdb = rb_iv_get(vbdb, BDBVNDATA);
+  Data_Get_Struct(vbdb, TCBDB, bdb);
+  cur = tcbdbcurnew(bdb);
+  vcur = Data_Wrap_Struct(cls_bdbcur_data, 0, tcbdbcurdel, cur);
+  rb_iv_set(vself, BDBCURVNDATA, vcur);
+  rb_iv_set(vself, BDBVNDATA, vbdb);
+  return Qnil;
+}
+
+
+static VALUE bdbcur_first(VALUE vself){
+  VALUE vcur;
+  BDBCUR *cur;
+  vcur = rb_iv_get(vself, BDBCURVNDATA);
+  Data_Get_Struct(vcur, BDBCUR, cur);
+  return tcbdbcurfirst(cur) ? Qtrue : Qfalse;
+}
+
+
+static VALUE bdbcur_last(VALUE vself){
+  VALUE vcur;
+  BDBCUR *cur;
+  vcur = rb_iv_get(vself, BDBCURVNDATA);
+  Data_Get_Struct(vcur, BDBCUR, cur);
+  return tcbdbcurlast(cur) ? Qtrue : Qfalse;
+}
+
+
+static VALUE bdbcur_jump(VALUE vself, VALUE vkey){
+  VALUE vcur;
+  BDBCUR *cur;
+  vkey = StringValueEx(vkey);
+  vcur = rb_iv_get(vself, BDBCURVNDATA);
+  Data_Get_Struct(vcur, BDBCUR, cur);
   return tcbdbcurjump(cur, RSTRING_PTR(vkey), RSTRING_LEN(vkey)) ? Qtrue : Qfalse;
 }
 
@@ -1886,6 +3245,8 @@ static void fdb_init(void){
   rb_define_const(cls_fdb, "OTRUNC", INT2NUM(FDBOTRUNC));
   rb_define_const(cls_fdb, "ONOLCK", INT2NUM(FDBONOLCK));
   rb_define_const(cls_fdb, "OLCKNB", INT2NUM(FDBOLCKNB));
+  rb_define_const(cls_fdb, "NUMI64", INT2NUM(FDBNUMI64));
+  rb_define_const(cls_fdb, "NUMF64", INT2NUM(FDBNUMF64));
   rb_define_private_method(cls_fdb, "initialize", fdb_initialize, 0);
   rb_define_method(cls_fdb, "errmsg", fdb_errmsg, -1);
   rb_define_method(cls_fdb, "ecode", fdb_ecode, 0);
@@ -1895,12 +3256,23 @@ static void fdb_init(void){
   rb_define_method(cls_fdb, "put", fdb_put, 2);
   rb_define_method(cls_fdb, "putkeep", fdb_putkeep, 2);
   rb_define_method(cls_fdb, "putcat", fdb_putcat, 2);
+  rb_define_method(cls_fdb, "append_batch", fdb_append_batch, -1);
   rb_define_method(cls_fdb, "out", fdb_out, 1);
   rb_define_method(cls_fdb, "get", fdb_get, 1);
+  rb_define_method(cls_fdb, "put_i64", fdb_put_i64, 2);
+  rb_define_method(cls_fdb, "get_i64", fdb_get_i64, 1);
+  rb_define_method(cls_fdb, "put_f64", fdb_put_f64, 2);
+  rb_define_method(cls_fdb, "get_f64", fdb_get_f64, 1);
   rb_define_method(cls_fdb, "vsiz", fdb_vsiz, 1);
   rb_define_method(cls_fdb, "iterinit", fdb_iterinit, 0);
   rb_define_method(cls_fdb, "iternext", fdb_iternext, 0);
   rb_define_method(cls_fdb, "range", fdb_range, -1);
+  rb_define_method(cls_fdb, "read_range", fdb_read_range, -1);
+  rb_define_method(cls_fdb, "sum", fdb_sum, -1);
+  rb_define_method(cls_fdb, "min", fdb_min, -1);
+  rb_define_method(cls_fdb, "max", fdb_max, -1);
+  rb_define_method(cls_fdb, "mean", fdb_mean, -1);
+  rb_define_method(cls_fdb, "histogram", fdb_histogram, -1);
   rb_define_method(cls_fdb, "addint", fdb_addint, 2);
   rb_define_method(cls_fdb, "adddouble", fdb_adddouble, 2);
   rb_define_method(cls_fdb, "sync", fdb_sync, 0);
@@ -2008,46 +3380,72 @@ static VALUE fdb_close(VALUE vself){
 static VALUE fdb_put(VALUE vself, VALUE vkey, VALUE vval){
   VALUE vfdb;
   TCFDB *fdb;
-  vkey = StringValueEx(vkey);
+  int64_t id;
+  id = fdbkeytoid(vkey);
   vval = StringValueEx(vval);
   vfdb = rb_iv_get(vself, FDBVNDATA);
   Data_Get_Struct(vfdb, TCFDB, fdb);
-  return tcfdbput2(fdb, RSTRING_PTR(vkey), RSTRING_LEN(vkey),
-		   RSTRING_PTR(vval), RSTRING_LEN(vval)) ? Qtrue : Qfalse;
+  return tcfdbput(fdb, id, RSTRING_PTR(vval), RSTRING_LEN(vval)) ? Qtrue : Qfalse;
 }
 
 
 static VALUE fdb_putkeep(VALUE vself, VALUE vkey, VALUE vval){
   VALUE vfdb;
   TCFDB *fdb;
-  vkey = StringValueEx(vkey);
+  int64_t id;
+  id = fdbkeytoid(vkey);
   vval = StringValueEx(vval);
   vfdb = rb_iv_get(vself, FDBVNDATA);
   Data_Get_Struct(vfdb, TCFDB, fdb);
-  return tcfdbputkeep2(fdb, RSTRING_PTR(vkey), RSTRING_LEN(vkey),
-		       RSTRING_PTR(vval), RSTRING_LEN(vval)) ? Qtrue : Qfalse;
+  return tcfdbputkeep(fdb, id, RSTRING_PTR(vval), RSTRING_LEN(vval)) ? Qtrue : Qfalse;
 }
 
 
 static VALUE fdb_putcat(VALUE vself, VALUE vkey, VALUE vval){
   VALUE vfdb;
   TCFDB *fdb;
-  vkey = StringValueEx(vkey);
+  int64_t id;
+  id = fdbkeytoid(vkey);
   vval = StringValueEx(vval);
   vfdb = rb_iv_get(vself, FDBVNDATA);
   Data_Get_Struct(vfdb, TCFDB, fdb);
-  return tcfdbputcat2(fdb, RSTRING_PTR(vkey), RSTRING_LEN(vkey),
-		      RSTRING_PTR(vval), RSTRING_LEN(vval)) ? Qtrue : Qfalse;
+  return tcfdbputcat(fdb, id, RSTRING_PTR(vval), RSTRING_LEN(vval)) ? Qtrue : Qfalse;
+}
+
+
+static VALUE fdb_append_batch(int argc, VALUE *argv, VALUE vself){
+  VALUE vfdb, vvals, vsync, vstrs, vval;
+  TCFDB *fdb;
+  int64_t id;
+  int i, num;
+  rb_scan_args(argc, argv, "11", &vvals, &vsync);
+  Check_Type(vvals, T_ARRAY);
+  num = RARRAY_LEN(vvals);
+  vstrs = rb_ary_new2(num);
+  for(i = 0; i < num; i++){
+    rb_ary_push(vstrs, StringValueEx(rb_ary_entry(vvals, i)));
+  }
+  vfdb = rb_iv_get(vself, FDBVNDATA);
+  Data_Get_Struct(vfdb, TCFDB, fdb);
+  id = (int64_t)tcfdbmax(fdb) + 1;
+  if(num > 0 && id + num - 1 > (int64_t)tcfdblimid(fdb)) return Qnil;
+  for(i = 0; i < num; i++){
+    vval = rb_ary_entry(vstrs, i);
+    if(!tcfdbputkeep(fdb, id + i, RSTRING_PTR(vval), RSTRING_LEN(vval))) return Qnil;
+  }
+  if(vsync != Qnil && vsync != Qfalse && !tcfdbsync(fdb)) return Qnil;
+  return LL2NUM(id);
 }
 
 
 static VALUE fdb_out(VALUE vself, VALUE vkey){
   VALUE vfdb;
   TCFDB *fdb;
-  vkey = StringValueEx(vkey);
+  int64_t id;
+  id = fdbkeytoid(vkey);
   vfdb = rb_iv_get(vself, FDBVNDATA);
   Data_Get_Struct(vfdb, TCFDB, fdb);
-  return tcfdbout2(fdb, RSTRING_PTR(vkey), RSTRING_LEN(vkey)) ? Qtrue : Qfalse;
+  return tcfdbout(fdb, id) ? Qtrue : Qfalse;
 }
 
 
@@ -2056,23 +3454,75 @@ static VALUE fdb_get(VALUE vself, VALUE vkey){
   TCFDB *fdb;
   char *vbuf;
   int vsiz;
-  vkey = StringValueEx(vkey);
+  int64_t id;
+  id = fdbkeytoid(vkey);
   vfdb = rb_iv_get(vself, FDBVNDATA);
   Data_Get_Struct(vfdb, TCFDB, fdb);
-  if(!(vbuf = tcfdbget2(fdb, RSTRING_PTR(vkey), RSTRING_LEN(vkey), &vsiz))) return Qnil;
+  if(!(vbuf = tcfdbget(fdb, id, &vsiz))) return Qnil;
   vval = rb_str_new(vbuf, vsiz);
   tcfree(vbuf);
   return vval;
 }
 
 
+static VALUE fdb_put_i64(VALUE vself, VALUE vkey, VALUE vnum){
+  VALUE vfdb;
+  TCFDB *fdb;
+  int64_t id, num;
+  id = fdbkeytoid(vkey);
+  num = NUM2LL(vnum);
+  vfdb = rb_iv_get(vself, FDBVNDATA);
+  Data_Get_Struct(vfdb, TCFDB, fdb);
+  return tcfdbput(fdb, id, &num, sizeof(num)) ? Qtrue : Qfalse;
+}
+
+
+static VALUE fdb_get_i64(VALUE vself, VALUE vkey){
+  VALUE vfdb;
+  TCFDB *fdb;
+  int64_t id, num;
+  id = fdbkeytoid(vkey);
+  vfdb = rb_iv_get(vself, FDBVNDATA);
+  Data_Get_Struct(vfdb, TCFDB, fdb);
+  if(tcfdbget4(fdb, id, &num, sizeof(num)) != sizeof(num)) return Qnil;
+  return LL2NUM(num);
+}
+
+
+static VALUE fdb_put_f64(VALUE vself, VALUE vkey, VALUE vnum){
+  VALUE vfdb;
+  TCFDB *fdb;
+  int64_t id;
+  double num;
+  id = fdbkeytoid(vkey);
+  num = NUM2DBL(vnum);
+  vfdb = rb_iv_get(vself, FDBVNDATA);
+  Data_Get_Struct(vfdb, TCFDB, fdb);
+  return tcfdbput(fdb, id, &num, sizeof(num)) ? Qtrue : Qfalse;
+}
+
+
+static VALUE fdb_get_f64(VALUE vself, VALUE vkey){
+  VALUE vfdb;
+  TCFDB *fdb;
+  int64_t id;
+  double num;
+  id = fdbkeytoid(vkey);
+  vfdb = rb_iv_get(vself, FDBVNDATA);
+  Data_Get_Struct(vfdb, TCFDB, fdb);
+  if(tcfdbget4(fdb, id, &num, sizeof(num)) != sizeof(num)) return Qnil;
+  return rb_float_new(num);
+}
+
+
 static VALUE fdb_vsiz(VALUE vself, VALUE vkey){
   VALUE vfdb;
   TCFDB *fdb;
-  vkey = StringValueEx(vkey);
+  int64_t id;
+  id = fdbkeytoid(vkey);
   vfdb = rb_iv_get(vself, FDBVNDATA);
   Data_Get_Struct(vfdb, TCFDB, fdb);
-  return INT2NUM(tcfdbvsiz2(fdb, RSTRING_PTR(vkey), RSTRING_LEN(vkey)));
+  return INT2NUM(tcfdbvsiz(fdb, id));
 }
 
 
@@ -2116,14 +3566,234 @@ static VALUE fdb_range(int argc, VALUE *argv, VALUE vself){
 }
 
 
+static VALUE fdb_read_range(int argc, VALUE *argv, VALUE vself){
+  VALUE vfdb, vlower, vupper, vbuf, vbits;
+  TCFDB *fdb;
+  char *wp;
+  unsigned char *bp;
+  int64_t lower, upper, id, num;
+  int width;
+  rb_scan_args(argc, argv, "21", &vlower, &vupper, &vbuf);
+  lower = fdbkeytoid(vlower);
+  upper = fdbkeytoid(vupper);
+  if(vbuf != Qnil) Check_Type(vbuf, T_STRING);
+  vfdb = rb_iv_get(vself, FDBVNDATA);
+  Data_Get_Struct(vfdb, TCFDB, fdb);
+  lower = fdbresolveid(fdb, lower);
+  upper = fdbresolveid(fdb, upper);
+  if(lower < 1) lower = 1;
+  if(upper > (int64_t)tcfdblimid(fdb)) upper = tcfdblimid(fdb);
+  width = tcfdbwidth(fdb);
+  num = (upper >= lower) ? upper - lower + 1 : 0;
+  if(width > 0 && num > LONG_MAX / width) rb_raise(rb_eArgError, "too large range");
+  if(vbuf == Qnil){
+    vbuf = rb_str_new(NULL, num * width);
+  } else {
+    rb_str_modify(vbuf);
+    rb_str_resize(vbuf, num * width);
+  }
+  vbits = rb_str_new(NULL, (num + 7) / 8);
+  wp = RSTRING_PTR(vbuf);
+  bp = (unsigned char *)RSTRING_PTR(vbits);
+  memset(wp, 0, num * width);
+  memset(bp, 0, (num + 7) / 8);
+  for(id = lower; id <= upper; id++){
+    if(tcfdbget4(fdb, id, wp, width) >= 0) bp[(id - lower) / 8] |= 1 << ((id - lower) % 8);
+    wp += width;
+  }
+  return rb_ary_new3(2, vbuf, vbits);
+}
+
+
+static void fdb_interval(TCFDB *fdb, VALUE vinterval, int64_t *lp, int64_t *up){
+  const char *ibuf, *pv, *ep;
+  int isiz;
+  *lp = tcfdbmin(fdb);
+  *up = tcfdbmax(fdb);
+  if(vinterval == Qnil) return;
+  vinterval = StringValueEx(vinterval);
+  ibuf = RSTRING_PTR(vinterval);
+  isiz = RSTRING_LEN(vinterval);
+  while(isiz > 0 && (*ibuf == '[' || *ibuf == ' ')){
+    ibuf++;
+    isiz--;
+  }
+  while(isiz > 0 && (ibuf[isiz-1] == ']' || ibuf[isiz-1] == ' ')){
+    isiz--;
+  }
+  if(!(pv = memchr(ibuf, ',', isiz))) pv = ibuf + isiz;
+  for(ep = pv; ep > ibuf && ep[-1] == ' '; ep--);
+  *lp = fdbresolveid(fdb, tcfdbkeytoid(ibuf, ep - ibuf));
+  if(pv < ibuf + isiz){
+    for(pv++; pv < ibuf + isiz && *pv == ' '; pv++);
+    *up = fdbresolveid(fdb, tcfdbkeytoid(pv, ibuf + isiz - pv));
+  } else {
+    *up = *lp;
+  }
+  if(*lp < 1) *lp = 1;
+  if(*up > (int64_t)tcfdbmax(fdb)) *up = tcfdbmax(fdb);
+}
+
+
+static void *fdb_aggscan(FDBAGG *agg){
+  int64_t ibuf[AGGBUFNUM];
+  double dbuf[AGGBUFNUM];
+  int64_t id, end, is0, is1, is2, is3, imin, imax;
+  double ds0, ds1, ds2, ds3, dmin, dmax, hwid, val;
+  int i, n, bidx;
+  is0 = is1 = is2 = is3 = 0;
+  ds0 = ds1 = ds2 = ds3 = 0;
+  imin = INT64_MAX;
+  imax = INT64_MIN;
+  dmin = HUGE_VAL;
+  dmax = -HUGE_VAL;
+  hwid = agg->hupp - agg->hlow;
+  for(id = agg->lower; id <= agg->upper; id = end){
+    end = (agg->upper - id >= AGGBUFNUM) ? id + AGGBUFNUM : agg->upper + 1;
+    n = 0;
+    if(agg->type == FDBNUMF64){
+      for(; id < end; id++){
+        if(tcfdbget4(agg->fdb, id, dbuf + n, sizeof(*dbuf)) == sizeof(*dbuf)) n++;
+      }
+      for(i = 0; i + 3 < n; i += 4){
+        ds0 += dbuf[i];
+        ds1 += dbuf[i+1];
+        ds2 += dbuf[i+2];
+        ds3 += dbuf[i+3];
+      }
+      for(; i < n; i++){
+        ds0 += dbuf[i];
+      }
+      for(i = 0; i < n; i++){
+        if(dbuf[i] < dmin) dmin = dbuf[i];
+        if(dbuf[i] > dmax) dmax = dbuf[i];
+      }
+    } else {
+      for(; id < end; id++){
+        if(tcfdbget4(agg->fdb, id, ibuf + n, sizeof(*ibuf)) == sizeof(*ibuf)) n++;
+      }
+      for(i = 0; i + 3 < n; i += 4){
+        is0 += ibuf[i];
+        is1 += ibuf[i+1];
+        is2 += ibuf[i+2];
+        is3 += ibuf[i+3];
+      }
+      for(; i < n; i++){
+        is0 += ibuf[i];
+      }
+      for(i = 0; i < n; i++){
+        if(ibuf[i] < imin) imin = ibuf[i];
+        if(ibuf[i] > imax) imax = ibuf[i];
+        dbuf[i] = ibuf[i];
+      }
+    }
+    if(agg->bnum > 0 && hwid > 0){
+      for(i = 0; i < n; i++){
+        val = dbuf[i];
+        if(val < agg->hlow || val > agg->hupp) continue;
+        bidx = (val - agg->hlow) / hwid * agg->bnum;
+        if(bidx >= agg->bnum) bidx = agg->bnum - 1;
+        agg->buckets[bidx]++;
+      }
+    }
+    agg->cnt += n;
+  }
+  agg->isum = is0 + is1 + is2 + is3;
+  agg->imin = imin;
+  agg->imax = imax;
+  agg->dsum = ds0 + ds1 + ds2 + ds3;
+  agg->dmin = dmin;
+  agg->dmax = dmax;
+  return NULL;
+}
+
+
+static void fdb_aggrun(VALUE vself, VALUE vinterval, VALUE vtype, FDBAGG *agg){
+  VALUE vfdb;
+  TCFDB *fdb;
+  vfdb = rb_iv_get(vself, FDBVNDATA);
+  Data_Get_Struct(vfdb, TCFDB, fdb);
+  agg->fdb = fdb;
+  agg->type = (vtype == Qnil) ? FDBNUMI64 : NUM2INT(vtype);
+  agg->cnt = 0;
+  fdb_interval(fdb, vinterval, &agg->lower, &agg->upper);
+  if(agg->bnum > 0) agg->buckets = tccalloc(agg->bnum, sizeof(*agg->buckets));
+  NOGVLCALL(fdb_aggscan, agg);
+}
+
+
+static VALUE fdb_sum(int argc, VALUE *argv, VALUE vself){
+  VALUE vinterval, vtype;
+  FDBAGG agg;
+  rb_scan_args(argc, argv, "02", &vinterval, &vtype);
+  memset(&agg, 0, sizeof(agg));
+  fdb_aggrun(vself, vinterval, vtype, &agg);
+  return (agg.type == FDBNUMF64) ? rb_float_new(agg.dsum) : LL2NUM(agg.isum);
+}
+
+
+static VALUE fdb_min(int argc, VALUE *argv, VALUE vself){
+  VALUE vinterval, vtype;
+  FDBAGG agg;
+  rb_scan_args(argc, argv, "02", &vinterval, &vtype);
+  memset(&agg, 0, sizeof(agg));
+  fdb_aggrun(vself, vinterval, vtype, &agg);
+  if(agg.cnt < 1) return Qnil;
+  return (agg.type == FDBNUMF64) ? rb_float_new(agg.dmin) : LL2NUM(agg.imin);
+}
+
+
+static VALUE fdb_max(int argc, VALUE *argv, VALUE vself){
+  VALUE vinterval, vtype;
+  FDBAGG agg;
+  rb_scan_args(argc, argv, "02", &vinterval, &vtype);
+  memset(&agg, 0, sizeof(agg));
+  fdb_aggrun(vself, vinterval, vtype, &agg);
+  if(agg.cnt < 1) return Qnil;
+  return (agg.type == FDBNUMF64) ? rb_float_new(agg.dmax) : LL2NUM(agg.imax);
+}
+
+
+static VALUE fdb_mean(int argc, VALUE *argv, VALUE vself){
+  VALUE vinterval, vtype;
+  FDBAGG agg;
+  rb_scan_args(argc, argv, "02", &vinterval, &vtype);
+  memset(&agg, 0, sizeof(agg));
+  fdb_aggrun(vself, vinterval, vtype, &agg);
+  if(agg.cnt < 1) return Qnil;
+  return rb_float_new(((agg.type == FDBNUMF64) ? agg.dsum : (double)agg.isum) / agg.cnt);
+}
+
+
+static VALUE fdb_histogram(int argc, VALUE *argv, VALUE vself){
+  VALUE vlower, vupper, vbnum, vinterval, vtype, vary;
+  FDBAGG agg;
+  int i;
+  rb_scan_args(argc, argv, "32", &vlower, &vupper, &vbnum, &vinterval, &vtype);
+  memset(&agg, 0, sizeof(agg));
+  agg.hlow = NUM2DBL(vlower);
+  agg.hupp = NUM2DBL(vupper);
+  agg.bnum = NUM2INT(vbnum);
+  if(agg.bnum < 1) rb_raise(rb_eArgError, "invalid number of buckets");
+  fdb_aggrun(vself, vinterval, vtype, &agg);
+  vary = rb_ary_new2(agg.bnum);
+  for(i = 0; i < agg.bnum; i++){
+    rb_ary_push(vary, LL2NUM(agg.buckets[i]));
+  }
+  tcfree(agg.buckets);
+  return vary;
+}
+
+
 static VALUE fdb_addint(VALUE vself, VALUE vkey, VALUE vnum){
   VALUE vfdb;
   TCFDB *fdb;
+  int64_t id;
   int num;
-  vkey = StringValueEx(vkey);
+  id = fdbkeytoid(vkey);
   vfdb = rb_iv_get(vself, FDBVNDATA);
   Data_Get_Struct(vfdb, TCFDB, fdb);
-  num = tcfdbaddint(fdb, tcfdbkeytoid(RSTRING_PTR(vkey), RSTRING_LEN(vkey)), NUM2INT(vnum));
+  num = tcfdbaddint(fdb, id, NUM2INT(vnum));
   return num == INT_MIN ? Qnil : INT2NUM(num);
 }
 
@@ -2131,11 +3801,12 @@ static VALUE fdb_addint(VALUE vself, VALUE vkey, VALUE vnum){
 static VALUE fdb_adddouble(VALUE vself, VALUE vkey, VALUE vnum){
   VALUE vfdb;
   TCFDB *fdb;
+  int64_t id;
   double num;
-  vkey = StringValueEx(vkey);
+  id = fdbkeytoid(vkey);
   vfdb = rb_iv_get(vself, FDBVNDATA);
   Data_Get_Struct(vfdb, TCFDB, fdb);
-  num = tcfdbadddouble(fdb, tcfdbkeytoid(RSTRING_PTR(vkey), RSTRING_LEN(vkey)), NUM2DBL(vnum));
+  num = tcfdbadddouble(fdb, id, NUM2DBL(vnum));
   return isnan(num) ? Qnil : rb_float_new(num);
 }
 
@@ -2216,11 +3887,12 @@ static VALUE fdb_fetch(int argc, VALUE *argv, VALUE vself){
   TCFDB *fdb;
   char *vbuf;
   int vsiz;
+  int64_t id;
   rb_scan_args(argc, argv, "11", &vkey, &vdef);
-  vkey = StringValueEx(vkey);
+  id = fdbkeytoid(vkey);
   vfdb = rb_iv_get(vself, FDBVNDATA);
   Data_Get_Struct(vfdb, TCFDB, fdb);
-  if((vbuf = tcfdbget2(fdb, RSTRING_PTR(vkey), RSTRING_LEN(vkey), &vsiz)) != NULL){
+  if((vbuf = tcfdbget(fdb, id, &vsiz)) != NULL){
     vval = rb_str_new(vbuf, vsiz);
     tcfree(vbuf);
   } else {
@@ -2233,10 +3905,11 @@ static VALUE fdb_fetch(int argc, VALUE *argv, VALUE vself){
 static VALUE fdb_check(VALUE vself, VALUE vkey){
   VALUE vfdb;
   TCFDB *fdb;
-  vkey = StringValueEx(vkey);
+  int64_t id;
+  id = fdbkeytoid(vkey);
   vfdb = rb_iv_get(vself, FDBVNDATA);
   Data_Get_Struct(vfdb, TCFDB, fdb);
-  return tcfdbvsiz2(fdb, RSTRING_PTR(vkey), RSTRING_LEN(vkey)) >= 0 ? Qtrue : Qfalse;
+  return tcfdbvsiz(fdb, id) >= 0 ? Qtrue : Qfalse;
 }
 
 
@@ -2403,61 +4076,397 @@ static VALUE fdb_values(VALUE vself){
 }
 
 
-static void tdb_init(void){
-  cls_tdb = rb_define_class_under(mod_tokyocabinet, "TDB", rb_cObject);
-  cls_tdb_data = rb_define_class_under(mod_tokyocabinet, "TDB_data", rb_cObject);
-  rb_define_const(cls_tdb, "ESUCCESS", INT2NUM(TCESUCCESS));
-  rb_define_const(cls_tdb, "ETHREAD", INT2NUM(TCETHREAD));
-  rb_define_const(cls_tdb, "EINVALID", INT2NUM(TCEINVALID));
-  rb_define_const(cls_tdb, "ENOFILE", INT2NUM(TCENOFILE));
-  rb_define_const(cls_tdb, "ENOPERM", INT2NUM(TCENOPERM));
-  rb_define_const(cls_tdb, "EMETA", INT2NUM(TCEMETA));
-  rb_define_const(cls_tdb, "ERHEAD", INT2NUM(TCERHEAD));
-  rb_define_const(cls_tdb, "EOPEN", INT2NUM(TCEOPEN));
-  rb_define_const(cls_tdb, "ECLOSE", INT2NUM(TCECLOSE));
-  rb_define_const(cls_tdb, "ETRUNC", INT2NUM(TCETRUNC));
-  rb_define_const(cls_tdb, "ESYNC", INT2NUM(TCESYNC));
-  rb_define_const(cls_tdb, "ESTAT", INT2NUM(TCESTAT));
-  rb_define_const(cls_tdb, "ESEEK", INT2NUM(TCESEEK));
-  rb_define_const(cls_tdb, "EREAD", INT2NUM(TCEREAD));
-  rb_define_const(cls_tdb, "EWRITE", INT2NUM(TCEWRITE));
-  rb_define_const(cls_tdb, "EMMAP", INT2NUM(TCEMMAP));
-  rb_define_const(cls_tdb, "ELOCK", INT2NUM(TCELOCK));
-  rb_define_const(cls_tdb, "EUNLINK", INT2NUM(TCEUNLINK));
-  rb_define_const(cls_tdb, "ERENAME", INT2NUM(TCERENAME));
-  rb_define_const(cls_tdb, "EMKDIR", INT2NUM(TCEMKDIR));
-  rb_define_const(cls_tdb, "ERMDIR", INT2NUM(TCERMDIR));
-  rb_define_const(cls_tdb, "EKEEP", INT2NUM(TCEKEEP));
-  rb_define_const(cls_tdb, "ENOREC", INT2NUM(TCENOREC));
-  rb_define_const(cls_tdb, "EMISC", INT2NUM(TCEMISC));
-  rb_define_const(cls_tdb, "TLARGE", INT2NUM(TDBTLARGE));
-  rb_define_const(cls_tdb, "TDEFLATE", INT2NUM(TDBTDEFLATE));
-  rb_define_const(cls_tdb, "TBZIP", INT2NUM(TDBTBZIP));
-  rb_define_const(cls_tdb, "TTCBS", INT2NUM(TDBTTCBS));
-  rb_define_const(cls_tdb, "OREADER", INT2NUM(TDBOREADER));
-  rb_define_const(cls_tdb, "OWRITER", INT2NUM(TDBOWRITER));
-  rb_define_const(cls_tdb, "OCREAT", INT2NUM(TDBOCREAT));
-  rb_define_const(cls_tdb, "OTRUNC", INT2NUM(TDBOTRUNC));
-  rb_define_const(cls_tdb, "ONOLCK", INT2NUM(TDBONOLCK));
-  rb_define_const(cls_tdb, "OLCKNB", INT2NUM(TDBOLCKNB));
-  rb_define_const(cls_tdb, "OTSYNC", INT2NUM(TDBOTSYNC));
-  rb_define_const(cls_tdb, "ITLEXICAL", INT2NUM(TDBITLEXICAL));
-  rb_define_const(cls_tdb, "ITDECIMAL", INT2NUM(TDBITDECIMAL));
-  rb_define_const(cls_tdb, "ITVOID", INT2NUM(TDBITVOID));
-  rb_define_const(cls_tdb, "ITKEEP", INT2NUM(TDBITKEEP));
-  rb_define_private_method(cls_tdb, "initialize", tdb_initialize, 0);
+static void fdbts_init(void){
+  cls_fdbts = rb_define_class_under(mod_tokyocabinet, "FDBTS", rb_cObject);
+  cls_fdbts_data = rb_define_class_under(mod_tokyocabinet, "FDBTS_data", rb_cObject);
+  rb_define_const(cls_fdbts, "AGGAVG", INT2NUM(FDBTSAGGAVG));
+  rb_define_const(cls_fdbts, "AGGMIN", INT2NUM(FDBTSAGGMIN));
+  rb_define_const(cls_fdbts, "AGGMAX", INT2NUM(FDBTSAGGMAX));
+  rb_define_const(cls_fdbts, "AGGSUM", INT2NUM(FDBTSAGGSUM));
+  rb_define_private_method(cls_fdbts, "initialize", fdbts_initialize, -1);
+  rb_define_method(cls_fdbts, "put", fdbts_put, 2);
+  rb_define_method(cls_fdbts, "get", fdbts_get, 1);
+  rb_define_method(cls_fdbts, "fetch", fdbts_fetch, -1);
+}
+
+
+static int64_t fdbts_floordiv(int64_t num, int64_t div){
+  int64_t quot;
+  quot = num / div;
+  if(num % div != 0 && (num < 0) != (div < 0)) quot--;
+  return quot;
+}
+
+
+static int64_t fdbts_slot(FDBTS *ts, int64_t bucket){
+  int64_t mod;
+  mod = bucket % ts->cap;
+  if(mod < 0) mod += ts->cap;
+  return mod + 1;
+}
+
+
+static VALUE fdbts_initialize(int argc, VALUE *argv, VALUE vself){
+  VALUE vfdb, vres, vcap, vts;
+  TCFDB *fdb;
+  FDBTS *ts;
+  int64_t res, cap;
+  rb_scan_args(argc, argv, "21", &vfdb, &vres, &vcap);
+  Check_Type(vfdb, T_OBJECT);
+  vfdb = rb_iv_get(vfdb, FDBVNDATA);
+  Data_Get_Struct(vfdb, TCFDB, fdb);
+  res = NUM2LL(vres);
+  cap = (vcap == Qnil) ? (int64_t)tcfdblimid(fdb) : NUM2LL(vcap);
+  if(tcfdbwidth(fdb) < sizeof(FDBTSREC)) rb_raise(rb_eArgError, "width of the database is too small");
+  if(res < 1) rb_raise(rb_eArgError, "invalid resolution");
+  if(cap < 1) rb_raise(rb_eArgError, "invalid capacity");
+  ts = tcmalloc(sizeof(*ts));
+  ts->fdb = fdb;
+  ts->res = res;
+  ts->cap = cap;
+  vts = Data_Wrap_Struct(cls_fdbts_data, 0, tcfree, ts);
+  rb_iv_set(vself, FDBTSVNDATA, vts);
+  rb_iv_set(vself, FDBVNDATA, vfdb);
+  return Qnil;
+}
+
+
+static VALUE fdbts_put(VALUE vself, VALUE vtime, VALUE vval){
+  VALUE vts;
+  FDBTS *ts;
+  FDBTSREC rec;
+  vts = rb_iv_get(vself, FDBTSVNDATA);
+  Data_Get_Struct(vts, FDBTS, ts);
+  memset(&rec, 0, sizeof(rec));
+  rec.bucket = fdbts_floordiv(NUM2LL(vtime), ts->res);
+  rec.value = NUM2DBL(vval);
+  return tcfdbput(ts->fdb, fdbts_slot(ts, rec.bucket), &rec, sizeof(rec)) ? Qtrue : Qfalse;
+}
+
+
+static VALUE fdbts_get(VALUE vself, VALUE vtime){
+  VALUE vts;
+  FDBTS *ts;
+  FDBTSREC rec;
+  int64_t bucket;
+  vts = rb_iv_get(vself, FDBTSVNDATA);
+  Data_Get_Struct(vts, FDBTS, ts);
+  bucket = fdbts_floordiv(NUM2LL(vtime), ts->res);
+  if(tcfdbget4(ts->fdb, fdbts_slot(ts, bucket), &rec, sizeof(rec)) != sizeof(rec) ||
+     rec.bucket != bucket) return Qnil;
+  return rb_float_new(rec.value);
+}
+
+
+static void *fdbts_scan(FDBTSREAD *rd){
+  FDBTSREC rec;
+  int64_t bucket, widx;
+  for(bucket = rd->bbeg; bucket <= rd->bend; bucket++){
+    if(tcfdbget4(rd->ts->fdb, fdbts_slot(rd->ts, bucket), &rec, sizeof(rec)) != sizeof(rec) ||
+       rec.bucket != bucket) continue;
+    widx = fdbts_floordiv(bucket, rd->wbnum) - rd->wbeg;
+    if(rd->cnts[widx] < 1){
+      rd->vals[widx] = rec.value;
+    } else {
+      switch(rd->agg){
+      case FDBTSAGGMIN:
+        if(rec.value < rd->vals[widx]) rd->vals[widx] = rec.value;
+        break;
+      case FDBTSAGGMAX:
+        if(rec.value > rd->vals[widx]) rd->vals[widx] = rec.value;
+        break;
+      default:
+        rd->vals[widx] += rec.value;
+        break;
+      }
+    }
+    rd->cnts[widx]++;
+  }
+  return NULL;
+}
+
+
+static VALUE fdbts_fetch(int argc, VALUE *argv, VALUE vself){
+  VALUE vts, vfrom, vto, vstep, vagg, vary, vval;
+  FDBTS *ts;
+  FDBTSREAD rd;
+  int64_t i, wnum;
+  rb_scan_args(argc, argv, "22", &vfrom, &vto, &vstep, &vagg);
+  vts = rb_iv_get(vself, FDBTSVNDATA);
+  Data_Get_Struct(vts, FDBTS, ts);
+  rd.ts = ts;
+  rd.bbeg = fdbts_floordiv(NUM2LL(vfrom), ts->res);
+  rd.bend = fdbts_floordiv(NUM2LL(vto), ts->res);
+  rd.wbnum = (vstep == Qnil) ? 1 : NUM2LL(vstep) / ts->res;
+  if(rd.wbnum < 1) rd.wbnum = 1;
+  rd.agg = (vagg == Qnil) ? FDBTSAGGAVG : NUM2INT(vagg);
+  vary = rb_ary_new();
+  if(rd.bend < rd.bbeg) return vary;
+  if(rd.bend - rd.bbeg >= ts->cap) rd.bbeg = rd.bend - ts->cap + 1;
+  rd.wbeg = fdbts_floordiv(rd.bbeg, rd.wbnum);
+  wnum = fdbts_floordiv(rd.bend, rd.wbnum) - rd.wbeg + 1;
+  rd.vals = tccalloc(wnum, sizeof(*rd.vals));
+  rd.cnts = tccalloc(wnum, sizeof(*rd.cnts));
+  NOGVLCALL(fdbts_scan, &rd);
+  for(i = 0; i < wnum; i++){
+    if(rd.cnts[i] < 1) continue;
+    vval = rb_float_new((rd.agg == FDBTSAGGAVG) ? rd.vals[i] / rd.cnts[i] : rd.vals[i]);
+    rb_ary_push(vary, rb_ary_new3(2, LL2NUM((rd.wbeg + i) * rd.wbnum * ts->res), vval));
+  }
+  tcfree(rd.cnts);
+  tcfree(rd.vals);
+  return vary;
+}
+
+
+static void fdbbm_init(void){
+  cls_fdbbm = rb_define_class_under(mod_tokyocabinet, "FDBBM", rb_cObject);
+  rb_define_private_method(cls_fdbbm, "initialize", fdbbm_initialize, 1);
+  rb_define_method(cls_fdbbm, "set", fdbbm_set, 1);
+  rb_define_method(cls_fdbbm, "clear", fdbbm_clear, 1);
+  rb_define_method(cls_fdbbm, "test", fdbbm_test, 1);
+  rb_define_method(cls_fdbbm, "count", fdbbm_count, -1);
+  rb_define_method(cls_fdbbm, "and", fdbbm_and, 1);
+  rb_define_method(cls_fdbbm, "or", fdbbm_or, 1);
+  rb_define_method(cls_fdbbm, "andnot", fdbbm_andnot, 1);
+}
+
+
+static int fdbbm_popcount(uint64_t word){
+#if defined(__GNUC__)
+  return __builtin_popcountll(word);
+#else
+  word = word - ((word >> 1) & 0x5555555555555555ULL);
+  word = (word & 0x3333333333333333ULL) + ((word >> 2) & 0x3333333333333333ULL);
+  word = (word + (word >> 4)) & 0x0f0f0f0f0f0f0f0fULL;
+  return (word * 0x0101010101010101ULL) >> 56;
+#endif
+}
+
+
+static int64_t fdbbm_bitnum(VALUE vnum){
+  int64_t num;
+  num = NUM2LL(vnum);
+  if(num < 0) rb_raise(rb_eArgError, "negative bit number");
+  return num;
+}
+
+
+static VALUE fdbbm_initialize(VALUE vself, VALUE vfdb){
+  TCFDB *fdb;
+  Check_Type(vfdb, T_OBJECT);
+  vfdb = rb_iv_get(vfdb, FDBVNDATA);
+  Check_Type(vfdb, T_DATA);
+  Data_Get_Struct(vfdb, TCFDB, fdb);
+  if(tcfdbwidth(fdb) < sizeof(uint64_t)) rb_raise(rb_eArgError, "width of the database is too small");
+  rb_iv_set(vself, FDBVNDATA, vfdb);
+  return Qnil;
+}
+
+
+static VALUE fdbbm_update(VALUE vself, VALUE vnum, bool on){
+  VALUE vfdb;
+  TCFDB *fdb;
+  int64_t num;
+  uint64_t word, nword;
+  num = fdbbm_bitnum(vnum);
+  vfdb = rb_iv_get(vself, FDBVNDATA);
+  Data_Get_Struct(vfdb, TCFDB, fdb);
+  if(tcfdbget4(fdb, num / 64 + 1, &word, sizeof(word)) != sizeof(word)) word = 0;
+  nword = on ? (word | (1ULL << (num % 64))) : (word & ~(1ULL << (num % 64)));
+  if(nword == word) return Qtrue;
+  if(nword == 0) return tcfdbout(fdb, num / 64 + 1) ? Qtrue : Qfalse;
+  return tcfdbput(fdb, num / 64 + 1, &nword, sizeof(nword)) ? Qtrue : Qfalse;
+}
+
+
+static VALUE fdbbm_set(VALUE vself, VALUE vnum){
+  return fdbbm_update(vself, vnum, true);
+}
+
+
+static VALUE fdbbm_clear(VALUE vself, VALUE vnum){
+  return fdbbm_update(vself, vnum, false);
+}
+
+
+static VALUE fdbbm_test(VALUE vself, VALUE vnum){
+  VALUE vfdb;
+  TCFDB *fdb;
+  int64_t num;
+  uint64_t word;
+  num = fdbbm_bitnum(vnum);
+  vfdb = rb_iv_get(vself, FDBVNDATA);
+  Data_Get_Struct(vfdb, TCFDB, fdb);
+  if(tcfdbget4(fdb, num / 64 + 1, &word, sizeof(word)) != sizeof(word)) return Qfalse;
+  return (word & (1ULL << (num % 64))) ? Qtrue : Qfalse;
+}
+
+
+static void *fdbbm_countscan(FDBBMOP *op){
+  uint64_t words[AGGBUFNUM];
+  int64_t wid, wbeg, wend, end;
+  int i, n;
+  wbeg = op->lower / 64 + 1;
+  wend = op->upper / 64 + 1;
+  for(wid = wbeg; wid <= wend; wid = end){
+    end = (wend - wid >= AGGBUFNUM) ? wid + AGGBUFNUM : wend + 1;
+    n = end - wid;
+    for(i = 0; i < n; i++){
+      if(tcfdbget4(op->fdb, wid + i, words + i, sizeof(*words)) != sizeof(*words)) words[i] = 0;
+    }
+    if(wid == wbeg) words[0] &= ~0ULL << (op->lower % 64);
+    if(end > wend) words[n-1] &= ~0ULL >> (63 - op->upper % 64);
+    for(i = 0; i < n; i++){
+      op->cnt += fdbbm_popcount(words[i]);
+    }
+  }
+  return NULL;
+}
+
+
+static VALUE fdbbm_count(int argc, VALUE *argv, VALUE vself){
+  VALUE vfdb, vlower, vupper;
+  TCFDB *fdb;
+  FDBBMOP op;
+  int64_t max;
+  rb_scan_args(argc, argv, "02", &vlower, &vupper);
+  vfdb = rb_iv_get(vself, FDBVNDATA);
+  Data_Get_Struct(vfdb, TCFDB, fdb);
+  max = (int64_t)tcfdbmax(fdb) * 64 - 1;
+  op.fdb = fdb;
+  op.lower = (vlower == Qnil) ? 0 : fdbbm_bitnum(vlower);
+  op.upper = (vupper == Qnil) ? max : fdbbm_bitnum(vupper);
+  if(op.upper > max) op.upper = max;
+  op.cnt = 0;
+  if(op.upper >= op.lower) NOGVLCALL(fdbbm_countscan, &op);
+  return LL2NUM(op.cnt);
+}
+
+
+static void *fdbbm_opscan(FDBBMOP *op){
+  uint64_t word, oword, nword;
+  int64_t wid, wend;
+  wend = tcfdbmax(op->fdb);
+  if(op->op == FDBBMOPOR && (int64_t)tcfdbmax(op->ofdb) > wend) wend = tcfdbmax(op->ofdb);
+  for(wid = 1; wid <= wend; wid++){
+    if(tcfdbget4(op->fdb, wid, &word, sizeof(word)) != sizeof(word)) word = 0;
+    if(tcfdbget4(op->ofdb, wid, &oword, sizeof(oword)) != sizeof(oword)) oword = 0;
+    switch(op->op){
+    case FDBBMOPAND:
+      nword = word & oword;
+      break;
+    case FDBBMOPOR:
+      nword = word | oword;
+      break;
+    default:
+      nword = word & ~oword;
+      break;
+    }
+    if(nword == word) continue;
+    if(nword == 0 ? !tcfdbout(op->fdb, wid) : !tcfdbput(op->fdb, wid, &nword, sizeof(nword))){
+      op->err = true;
+      break;
+    }
+  }
+  return NULL;
+}
+
+
+static VALUE fdbbm_setop(VALUE vself, VALUE vother, int op){
+  VALUE vfdb, vofdb;
+  FDBBMOP bop;
+  if(!rb_obj_is_kind_of(vother, cls_fdbbm)) rb_raise(rb_eArgError, "not a bitmap object");
+  vfdb = rb_iv_get(vself, FDBVNDATA);
+  Data_Get_Struct(vfdb, TCFDB, bop.fdb);
+  vofdb = rb_iv_get(vother, FDBVNDATA);
+  Data_Get_Struct(vofdb, TCFDB, bop.ofdb);
+  bop.op = op;
+  bop.err = false;
+  fdbbm_opscan(&bop);
+  return bop.err ? Qfalse : Qtrue;
+}
+
+
+static VALUE fdbbm_and(VALUE vself, VALUE vother){
+  return fdbbm_setop(vself, vother, FDBBMOPAND);
+}
+
+
+static VALUE fdbbm_or(VALUE vself, VALUE vother){
+  return fdbbm_setop(vself, vother, FDBBMOPOR);
+}
+
+
+static VALUE fdbbm_andnot(VALUE vself, VALUE vother){
+  return fdbbm_setop(vself, vother, FDBBMOPANDNOT);
+}
+
+
+static void tdb_init(void){
+  cls_tdb = rb_define_class_under(mod_tokyocabinet, "TDB", rb_cObject);
+  cls_tdb_data = rb_define_class_under(mod_tokyocabinet, "TDB_data", rb_cObject);
+  rb_define_const(cls_tdb, "ESUCCESS", INT2NUM(TCESUCCESS));
+  rb_define_const(cls_tdb, "ETHREAD", INT2NUM(TCETHREAD));
+  rb_define_const(cls_tdb, "EINVALID", INT2NUM(TCEINVALID));
+  rb_define_const(cls_tdb, "ENOFILE", INT2NUM(TCENOFILE));
+  rb_define_const(cls_tdb, "ENOPERM", INT2NUM(TCENOPERM));
+  rb_define_const(cls_tdb, "EMETA", INT2NUM(TCEMETA));
+  rb_define_const(cls_tdb, "ERHEAD", INT2NUM(TCERHEAD));
+  rb_define_const(cls_tdb, "EOPEN", INT2NUM(TCEOPEN));
+  rb_define_const(cls_tdb, "ECLOSE", INT2NUM(TCECLOSE));
+  rb_define_const(cls_tdb, "ETRUNC", INT2NUM(TCETRUNC));
+  rb_define_const(cls_tdb, "ESYNC", INT2NUM(TCESYNC));
+  rb_define_const(cls_tdb, "ESTAT", INT2NUM(TCESTAT));
+  rb_define_const(cls_tdb, "ESEEK", INT2NUM(TCESEEK));
+  rb_define_const(cls_tdb, "EREAD", INT2NUM(TCEREAD));
+  rb_define_const(cls_tdb, "EWRITE", INT2NUM(TCEWRITE));
+  rb_define_const(cls_tdb, "EMMAP", INT2NUM(TCEMMAP));
+  rb_define_const(cls_tdb, "ELOCK", INT2NUM(TCELOCK));
+  rb_define_const(cls_tdb, "EUNLINK", INT2NUM(TCEUNLINK));
+  rb_define_const(cls_tdb, "ERENAME", INT2NUM(TCERENAME));
+  rb_define_const(cls_tdb, "EMKDIR", INT2NUM(TCEMKDIR));
+  rb_define_const(cls_tdb, "ERMDIR", INT2NUM(TCERMDIR));
+  rb_define_const(cls_tdb, "EKEEP", INT2NUM(TCEKEEP));
+  rb_define_const(cls_tdb, "ENOREC", INT2NUM(TCENOREC));
+  rb_define_const(cls_tdb, "EMISC", INT2NUM(TCEMISC));
+  rb_define_const(cls_tdb, "TLARGE", INT2NUM(TDBTLARGE));
+  rb_define_const(cls_tdb, "TDEFLATE", INT2NUM(TDBTDEFLATE));
+  rb_define_const(cls_tdb, "TBZIP", INT2NUM(TDBTBZIP));
+  rb_define_const(cls_tdb, "TTCBS", INT2NUM(TDBTTCBS));
+  rb_define_const(cls_tdb, "OREADER", INT2NUM(TDBOREADER));
+  rb_define_const(cls_tdb, "OWRITER", INT2NUM(TDBOWRITER));
+  rb_define_const(cls_tdb, "OCREAT", INT2NUM(TDBOCREAT));
+  rb_define_const(cls_tdb, "OTRUNC", INT2NUM(TDBOTRUNC));
+  rb_define_const(cls_tdb, "ONOLCK", INT2NUM(TDBONOLCK));
+  rb_define_const(cls_tdb, "OLCKNB", INT2NUM(TDBOLCKNB));
+  rb_define_const(cls_tdb, "OTSYNC", INT2NUM(TDBOTSYNC));
+  rb_define_const(cls_tdb, "ITLEXICAL", INT2NUM(TDBITLEXICAL));
+  rb_define_const(cls_tdb, "ITDECIMAL", INT2NUM(TDBITDECIMAL));
+  rb_define_const(cls_tdb, "ITTOKEN", INT2NUM(TDBITTOKEN));
+  rb_define_const(cls_tdb, "ITQGRAM", INT2NUM(TDBITQGRAM));
+  rb_define_const(cls_tdb, "ITOPT", INT2NUM(TDBITOPT));
+  rb_define_const(cls_tdb, "ITVOID", INT2NUM(TDBITVOID));
+  rb_define_const(cls_tdb, "ITKEEP", INT2NUM(TDBITKEEP));
+  rb_define_const(cls_tdb, "CTSTR", INT2NUM(TDBCTSTR));
+  rb_define_const(cls_tdb, "CTINT", INT2NUM(TDBCTINT));
+  rb_define_const(cls_tdb, "CTFLOAT", INT2NUM(TDBCTFLOAT));
+  rb_define_const(cls_tdb, "CTBOOL", INT2NUM(TDBCTBOOL));
+  rb_define_private_method(cls_tdb, "initialize", tdb_initialize, 0);
   rb_define_method(cls_tdb, "errmsg", tdb_errmsg, -1);
   rb_define_method(cls_tdb, "ecode", tdb_ecode, 0);
   rb_define_method(cls_tdb, "tune", tdb_tune, -1);
   rb_define_method(cls_tdb, "setcache", tdb_setcache, -1);
   rb_define_method(cls_tdb, "setxmsiz", tdb_setxmsiz, -1);
+  rb_define_method(cls_tdb, "adjcache", tdb_adjcache, -1);
   rb_define_method(cls_tdb, "open", tdb_open, -1);
   rb_define_method(cls_tdb, "close", tdb_close, 0);
   rb_define_method(cls_tdb, "put", tdb_put, 2);
   rb_define_method(cls_tdb, "putkeep", tdb_putkeep, 2);
   rb_define_method(cls_tdb, "putcat", tdb_putcat, 2);
   rb_define_method(cls_tdb, "out", tdb_out, 1);
-  rb_define_method(cls_tdb, "get", tdb_get, 1);
+  rb_define_method(cls_tdb, "get", tdb_get, -1);
+  rb_define_method(cls_tdb, "getcol", tdb_getcol, 2);
   rb_define_method(cls_tdb, "vsiz", tdb_vsiz, 1);
   rb_define_method(cls_tdb, "iterinit", tdb_iterinit, 0);
   rb_define_method(cls_tdb, "iternext", tdb_iternext, 0);
@@ -2475,8 +4484,11 @@ static void tdb_init(void){
   rb_define_method(cls_tdb, "rnum", tdb_rnum, 0);
   rb_define_method(cls_tdb, "fsiz", tdb_fsiz, 0);
   rb_define_method(cls_tdb, "setindex", tdb_setindex, 2);
+  rb_define_method(cls_tdb, "bulkbegin", tdb_bulkbegin, 0);
+  rb_define_method(cls_tdb, "bulkend", tdb_bulkend, 0);
+  rb_define_method(cls_tdb, "setschema", tdb_setschema, -1);
   rb_define_method(cls_tdb, "genuid", tdb_genuid, 0);
-  rb_define_method(cls_tdb, "[]", tdb_get, 1);
+  rb_define_method(cls_tdb, "[]", tdb_get, -1);
   rb_define_method(cls_tdb, "[]=", tdb_put, 2);
   rb_define_method(cls_tdb, "store", tdb_put, 2);
   rb_define_method(cls_tdb, "delete", tdb_out, 1);
@@ -2498,12 +4510,22 @@ static void tdb_init(void){
 }
 
 
+static void tdb_del(TCTDB *tdb){
+  cachegrant(tdb, 0);
+  tdbbulkrestore(tdb);
+  tctdbdel(tdb);
+}
+
+
 static VALUE tdb_initialize(VALUE vself){
   VALUE vtdb;
   TCTDB *tdb;
   tdb = tctdbnew();
   tctdbsetmutex(tdb);
-  vtdb = Data_Wrap_Struct(cls_tdb_data, 0, tctdbdel, tdb);
+  vtdb = Data_Wrap_Struct(cls_tdb_data, 0, tdb_del, tdb);
+  rb_iv_set(vtdb, TDBVNSCHEMA, Qnil);
+  rb_iv_set(vtdb, TDBVNBULK, Qnil);
+  rb_iv_set(vtdb, TDBVNTRAN, Qnil);
   rb_iv_set(vself, TDBVNDATA, vtdb);
   return Qnil;
 }
@@ -2574,25 +4596,61 @@ static VALUE tdb_setxmsiz(int argc, VALUE *argv, VALUE vself){
 }
 
 
+static VALUE tdb_adjcache(int argc, VALUE *argv, VALUE vself){
+  VALUE vtdb, vratio, vlimit;
+  TCTDB *tdb;
+  double ratio;
+  int64_t limit, size;
+  rb_scan_args(argc, argv, "11", &vratio, &vlimit);
+  ratio = NUM2DBL(vratio);
+  limit = (vlimit == Qnil) ? -1 : NUM2LL(vlimit);
+  vtdb = rb_iv_get(vself, TDBVNDATA);
+  Data_Get_Struct(vtdb, TCTDB, tdb);
+  if(ratio < 0) return Qfalse;
+  if((size = tdbadjcache(tdb, ratio, cacheavail(tdb, limit))) < 0) return Qfalse;
+  cachegrant(tdb, size);
+  return Qtrue;
+}
+
+
 static VALUE tdb_open(int argc, VALUE *argv, VALUE vself){
   VALUE vtdb, vpath, vomode;
   TCTDB *tdb;
+  TDBBULK bulk;
+  char *bpath;
   int omode;
   rb_scan_args(argc, argv, "11", &vpath, &vomode);
   Check_Type(vpath, T_STRING);
   omode = (vomode == Qnil) ? TDBOREADER : NUM2INT(vomode);
   vtdb = rb_iv_get(vself, TDBVNDATA);
   Data_Get_Struct(vtdb, TCTDB, tdb);
-  return tctdbopen(tdb, RSTRING_PTR(vpath), omode) ? Qtrue : Qfalse;
+  if(!tctdbopen(tdb, RSTRING_PTR(vpath), omode)) return Qfalse;
+  if((omode & TDBOWRITER) && (omode & TDBOTRUNC)){
+    if((bpath = tdbbulkpath(tdb)) != NULL){
+      unlink(bpath);
+      tcfree(bpath);
+    }
+  } else if(omode & TDBOWRITER){
+    bulk.tdb = tdb;
+    bulk.err = false;
+    NOGVLCALL(tdb_bulkbuild, &bulk);
+  }
+  return Qtrue;
 }
 
 
 static VALUE tdb_close(VALUE vself){
   VALUE vtdb;
   TCTDB *tdb;
+  bool err;
   vtdb = rb_iv_get(vself, TDBVNDATA);
   Data_Get_Struct(vtdb, TCTDB, tdb);
-  return tctdbclose(tdb) ? Qtrue : Qfalse;
+  err = false;
+  if(rb_iv_get(vtdb, TDBVNBULK) != Qnil && tdb_bulkend(vself) != Qtrue) err = true;
+  rb_iv_set(vtdb, TDBVNTRAN, Qnil);
+  cachegrant(tdb, 0);
+  if(!tctdbclose(tdb)) err = true;
+  return err ? Qfalse : Qtrue;
 }
 
 
@@ -2651,17 +4709,37 @@ static VALUE tdb_out(VALUE vself, VALUE vpkey){
 }
 
 
-static VALUE tdb_get(VALUE vself, VALUE vpkey){
-  VALUE vtdb, vcols;
+static VALUE tdb_get(int argc, VALUE *argv, VALUE vself){
+  VALUE vtdb, vpkey, vnames;
+  TCTDB *tdb;
+  TDBDECODE dec;
+  rb_scan_args(argc, argv, "11", &vpkey, &vnames);
+  vpkey = StringValueEx(vpkey);
+  if(vnames != Qnil) Check_Type(vnames, T_ARRAY);
+  vtdb = rb_iv_get(vself, TDBVNDATA);
+  Data_Get_Struct(vtdb, TCTDB, tdb);
+  if(!(dec.cols = tctdbget(tdb, RSTRING_PTR(vpkey), RSTRING_LEN(vpkey)))) return Qnil;
+  dec.vtdb = vtdb;
+  dec.vnames = vnames;
+  return rb_ensure(tdbdecoderun, (VALUE)&dec, tdbdecodefree, (VALUE)&dec);
+}
+
+
+static VALUE tdb_getcol(VALUE vself, VALUE vpkey, VALUE vname){
+  VALUE vtdb, vval;
   TCTDB *tdb;
   TCMAP *cols;
+  const char *vbuf;
+  int vsiz;
   vpkey = StringValueEx(vpkey);
+  vname = StringValueEx(vname);
   vtdb = rb_iv_get(vself, TDBVNDATA);
   Data_Get_Struct(vtdb, TCTDB, tdb);
   if(!(cols = tctdbget(tdb, RSTRING_PTR(vpkey), RSTRING_LEN(vpkey)))) return Qnil;
-  vcols = maptovhash(cols);
+  vbuf = tcmapget(cols, RSTRING_PTR(vname), RSTRING_LEN(vname), &vsiz);
+  vval = vbuf ? tdbdecodeval(tdbcoltype(vtdb, vname), vbuf, vsiz) : Qnil;
   tcmapdel(cols);
-  return vcols;
+  return vval;
 }
 
 
@@ -2788,7 +4866,9 @@ static VALUE tdb_tranbegin(VALUE vself){
   TCTDB *tdb;
   vtdb = rb_iv_get(vself, TDBVNDATA);
   Data_Get_Struct(vtdb, TCTDB, tdb);
-  return tctdbtranbegin(tdb) ? Qtrue : Qfalse;
+  if(!tctdbtranbegin(tdb)) return Qfalse;
+  rb_iv_set(vtdb, TDBVNTRAN, rb_thread_current());
+  return Qtrue;
 }
 
 
@@ -2797,6 +4877,7 @@ static VALUE tdb_trancommit(VALUE vself){
   TCTDB *tdb;
   vtdb = rb_iv_get(vself, TDBVNDATA);
   Data_Get_Struct(vtdb, TCTDB, tdb);
+  rb_iv_set(vtdb, TDBVNTRAN, Qnil);
   return tctdbtrancommit(tdb) ? Qtrue : Qfalse;
 }
 
@@ -2806,6 +4887,7 @@ static VALUE tdb_tranabort(VALUE vself){
   TCTDB *tdb;
   vtdb = rb_iv_get(vself, TDBVNDATA);
   Data_Get_Struct(vtdb, TCTDB, tdb);
+  rb_iv_set(vtdb, TDBVNTRAN, Qnil);
   return tctdbtranabort(tdb) ? Qtrue : Qfalse;
 }
 
@@ -2850,6 +4932,94 @@ static VALUE tdb_setindex(VALUE vself, VALUE vname, VALUE vtype){
 }
 
 
+static VALUE tdb_bulkbegin(VALUE vself){
+  VALUE vtdb;
+  TCTDB *tdb;
+  TCLIST *idxs;
+  char numbuf[NUMBUFSIZ], *bpath;
+  int i, num;
+  vtdb = rb_iv_get(vself, TDBVNDATA);
+  Data_Get_Struct(vtdb, TCTDB, tdb);
+  if(rb_iv_get(vtdb, TDBVNBULK) != Qnil || !tdb->open) return Qfalse;
+  idxs = tclistnew();
+  if(tdb->mmtx) pthread_rwlock_rdlock(tdb->mmtx);
+  for(i = 0; i < tdb->inum; i++){
+    tclistpush2(idxs, tdb->idxs[i].name);
+    sprintf(numbuf, "%d", tdb->idxs[i].type);
+    tclistpush2(idxs, numbuf);
+  }
+  if(tdb->mmtx) pthread_rwlock_unlock(tdb->mmtx);
+  if(!tdbbulksave(tdb, idxs)){
+    tclistdel(idxs);
+    return Qfalse;
+  }
+  num = tclistnum(idxs);
+  for(i = 0; i < num - 1; i += 2){
+    if(!tctdbsetindex(tdb, tclistval2(idxs, i), TDBITVOID)) break;
+  }
+  if(i < num - 1){
+    for(i -= 2; i >= 0; i -= 2){
+      tctdbsetindex(tdb, tclistval2(idxs, i), tcatoi(tclistval2(idxs, i + 1)));
+    }
+    if((bpath = tdbbulkpath(tdb)) != NULL){
+      unlink(bpath);
+      tcfree(bpath);
+    }
+    tclistdel(idxs);
+    return Qfalse;
+  }
+  tclistdel(idxs);
+  rb_iv_set(vtdb, TDBVNBULK, Qtrue);
+  return Qtrue;
+}
+
+
+static void *tdb_bulkbuild(TDBBULK *bulk){
+  if(!tdbbulkrestore(bulk->tdb)) bulk->err = true;
+  return NULL;
+}
+
+
+static VALUE tdb_bulkend(VALUE vself){
+  VALUE vtdb;
+  TDBBULK bulk;
+  vtdb = rb_iv_get(vself, TDBVNDATA);
+  Data_Get_Struct(vtdb, TCTDB, bulk.tdb);
+  if(rb_iv_get(vtdb, TDBVNBULK) == Qnil) return Qfalse;
+  rb_iv_set(vtdb, TDBVNBULK, Qnil);
+  bulk.err = false;
+  NOGVLCALL(tdb_bulkbuild, &bulk);
+  return bulk.err ? Qfalse : Qtrue;
+}
+
+
+static VALUE tdb_setschema(int argc, VALUE *argv, VALUE vself){
+  VALUE vtdb, vschema, vcls, vkeys, vnames, vtypes;
+  int i, num, type;
+  rb_scan_args(argc, argv, "11", &vschema, &vcls);
+  vtdb = rb_iv_get(vself, TDBVNDATA);
+  if(vschema == Qnil){
+    rb_iv_set(vtdb, TDBVNSCHEMA, Qnil);
+    return Qtrue;
+  }
+  Check_Type(vschema, T_HASH);
+  if(vcls != Qnil && (TYPE(vcls) != T_CLASS || rb_class_inherited_p(vcls, rb_cStruct) != Qtrue))
+    rb_raise(rb_eArgError, "not a subclass of Struct");
+  vkeys = rb_funcall(vschema, rb_intern("keys"), 0);
+  num = RARRAY_LEN(vkeys);
+  vnames = rb_ary_new2(num);
+  vtypes = rb_ary_new2(num);
+  for(i = 0; i < num; i++){
+    type = NUM2INT(rb_hash_aref(vschema, rb_ary_entry(vkeys, i)));
+    if(type < TDBCTSTR || type > TDBCTBOOL) rb_raise(rb_eArgError, "invalid column type");
+    rb_ary_push(vnames, StringValueEx(rb_ary_entry(vkeys, i)));
+    rb_ary_push(vtypes, INT2FIX(type));
+  }
+  rb_iv_set(vtdb, TDBVNSCHEMA, rb_ary_new3(3, vnames, vtypes, vcls));
+  return Qtrue;
+}
+
+
 static VALUE tdb_genuid(VALUE vself){
   VALUE vtdb;
   TCTDB *tdb;
@@ -3014,6 +5184,10 @@ static void tdbqry_init(void){
   rb_define_const(cls_tdbqry, "QCNUMLE", INT2NUM(TDBQCNUMLE));
   rb_define_const(cls_tdbqry, "QCNUMBT", INT2NUM(TDBQCNUMBT));
   rb_define_const(cls_tdbqry, "QCNUMOREQ", INT2NUM(TDBQCNUMOREQ));
+  rb_define_const(cls_tdbqry, "QCFTSPH", INT2NUM(TDBQCFTSPH));
+  rb_define_const(cls_tdbqry, "QCFTSAND", INT2NUM(TDBQCFTSAND));
+  rb_define_const(cls_tdbqry, "QCFTSOR", INT2NUM(TDBQCFTSOR));
+  rb_define_const(cls_tdbqry, "QCFTSEX", INT2NUM(TDBQCFTSEX));
   rb_define_const(cls_tdbqry, "QCNEGATE", INT2NUM(TDBQCNEGATE));
   rb_define_const(cls_tdbqry, "QCNOIDX", INT2NUM(TDBQCNOIDX));
   rb_define_const(cls_tdbqry, "QOSTRASC", INT2NUM(TDBQOSTRASC));
@@ -3023,22 +5197,53 @@ static void tdbqry_init(void){
   rb_define_const(cls_tdbqry, "QPPUT", INT2NUM(TDBQPPUT));
   rb_define_const(cls_tdbqry, "QPOUT", INT2NUM(TDBQPOUT));
   rb_define_const(cls_tdbqry, "QPSTOP", INT2NUM(TDBQPSTOP));
+  rb_define_const(cls_tdbqry, "MSUNION", INT2NUM(TDBMSUNION));
+  rb_define_const(cls_tdbqry, "MSISECT", INT2NUM(TDBMSISECT));
+  rb_define_const(cls_tdbqry, "MSDIFF", INT2NUM(TDBMSDIFF));
+  rb_define_const(cls_tdbqry, "QUSET", INT2NUM(TDBQRYUSET));
+  rb_define_const(cls_tdbqry, "QUADD", INT2NUM(TDBQRYUADD));
+  rb_define_const(cls_tdbqry, "QUCAT", INT2NUM(TDBQRYUCAT));
+  rb_define_const(cls_tdbqry, "QUDEL", INT2NUM(TDBQRYUDEL));
+  rb_define_const(cls_tdbqry, "AGGCOUNT", INT2NUM(TDBQRYAGGCOUNT));
+  rb_define_const(cls_tdbqry, "AGGSUM", INT2NUM(TDBQRYAGGSUM));
+  rb_define_const(cls_tdbqry, "AGGMIN", INT2NUM(TDBQRYAGGMIN));
+  rb_define_const(cls_tdbqry, "AGGMAX", INT2NUM(TDBQRYAGGMAX));
+  rb_define_const(cls_tdbqry, "AGGAVG", INT2NUM(TDBQRYAGGAVG));
   rb_define_private_method(cls_tdbqry, "initialize", tdbqry_initialize, 1);
   rb_define_method(cls_tdbqry, "addcond", tdbqry_addcond, 3);
   rb_define_method(cls_tdbqry, "setorder", tdbqry_setorder, 2);
   rb_define_method(cls_tdbqry, "setlimit", tdbqry_setlimit, -1);
   rb_define_method(cls_tdbqry, "setmax", tdbqry_setlimit, -1);
   rb_define_method(cls_tdbqry, "search", tdbqry_search, 0);
+  rb_define_method(cls_tdbqry, "searchrows", tdbqry_searchrows, -1);
   rb_define_method(cls_tdbqry, "searchout", tdbqry_searchout, 0);
-  rb_define_method(cls_tdbqry, "proc", tdbqry_proc, 0);
+  rb_define_method(cls_tdbqry, "proc", tdbqry_proc, -1);
   rb_define_method(cls_tdbqry, "hint", tdbqry_hint, 0);
+  rb_define_method(cls_tdbqry, "execute", tdbqry_execute, -1);
+  rb_define_method(cls_tdbqry, "metasearch", tdbqry_metasearch, -1);
+  rb_define_method(cls_tdbqry, "count", tdbqry_count, 0);
+  rb_define_method(cls_tdbqry, "exists?", tdbqry_exists, 0);
+  rb_define_method(cls_tdbqry, "aggregate", tdbqry_aggregate, 2);
+  rb_define_method(cls_tdbqry, "update", tdbqry_update, 1);
+  rb_define_method(cls_tdbqry, "top", tdbqry_top, 3);
 }
 
 
 static int tdbqry_procrec(const void *pkbuf, int pksiz, TCMAP *cols, void *opq){
   VALUE vpkey, vcols, vrv, vkeys, vkey, vval;
+  TDBQRYPROCOP *op;
   int i, rv, num;
   vpkey = rb_str_new(pkbuf, pksiz);
+  if(opq){
+    op = opq;
+    op->row->cols = cols;
+    op->row->dirty = false;
+    vrv = rb_yield_values(2, vpkey, op->vrow);
+    op->row->cols = NULL;
+    rv = (vrv == Qnil) ? 0 : NUM2INT(vrv);
+    if(!op->row->dirty) rv &= ~TDBQPPUT;
+    return rv;
+  }
   vcols = maptovhash(cols);
   vrv = rb_yield_values(2, vpkey, vcols);
   rv = (vrv == Qnil) ? 0 : NUM2INT(vrv);
@@ -3069,6 +5274,7 @@ static VALUE tdbqry_initialize(VALUE vself, VALUE vtdb){
   vqry = Data_Wrap_Struct(cls_tdbqry_data, 0, tctdbqrydel, qry);
   rb_iv_set(vself, TDBQRYVNDATA, vqry);
   rb_iv_set(vself, TDBVNDATA, vtdb);
+  rb_iv_set(vself, TDBQRYVNTPL, rb_ary_new());
   return Qnil;
 }
 
@@ -3077,10 +5283,13 @@ static VALUE tdbqry_addcond(VALUE vself, VALUE vname, VALUE vop, VALUE vexpr){
   VALUE vqry;
   TDBQRY *qry;
   vname = StringValueEx(vname);
-  vexpr = StringValueEx(vexpr);
+  if(!SYMBOL_P(vexpr)) vexpr = StringValueEx(vexpr);
+  vop = INT2NUM(NUM2INT(vop));
   vqry = rb_iv_get(vself, TDBQRYVNDATA);
   Data_Get_Struct(vqry, TDBQRY, qry);
-  tctdbqryaddcond(qry, RSTRING_PTR(vname), NUM2INT(vop), RSTRING_PTR(vexpr));
+  if(!SYMBOL_P(vexpr)) tctdbqryaddcond(qry, RSTRING_PTR(vname), NUM2INT(vop), RSTRING_PTR(vexpr));
+  rb_ary_push(rb_iv_get(vself, TDBQRYVNTPL),
+              rb_ary_new3(4, INT2FIX(TDBQRYTCOND), vname, vop, vexpr));
   return Qnil;
 }
 
@@ -3092,6 +5301,8 @@ static VALUE tdbqry_setorder(VALUE vself, VALUE vname, VALUE vtype){
   vqry = rb_iv_get(vself, TDBQRYVNDATA);
   Data_Get_Struct(vqry, TDBQRY, qry);
   tctdbqrysetorder(qry, RSTRING_PTR(vname), NUM2INT(vtype));
+  rb_ary_push(rb_iv_get(vself, TDBQRYVNTPL),
+              rb_ary_new3(3, INT2FIX(TDBQRYTORDER), vname, INT2NUM(NUM2INT(vtype))));
   return Qnil;
 }
 
@@ -3106,16 +5317,17 @@ static VALUE tdbqry_setlimit(int argc, VALUE *argv, VALUE vself){
   vqry = rb_iv_get(vself, TDBQRYVNDATA);
   Data_Get_Struct(vqry, TDBQRY, qry);
   tctdbqrysetlimit(qry, max, skip);
+  rb_ary_push(rb_iv_get(vself, TDBQRYVNTPL),
+              rb_ary_new3(3, INT2FIX(TDBQRYTLIMIT), INT2NUM(max), INT2NUM(skip)));
   return Qnil;
 }
 
 
 static VALUE tdbqry_search(VALUE vself){
-  VALUE vqry, vary;
+  VALUE vary;
   TDBQRY *qry;
   TCLIST *res;
-  vqry = rb_iv_get(vself, TDBQRYVNDATA);
-  Data_Get_Struct(vqry, TDBQRY, qry);
+  qry = tdbqry_native(vself);
   res = tctdbqrysearch(qry);
   vary = listtovary(res);
   tclistdel(res);
@@ -3123,31 +5335,1130 @@ static VALUE tdbqry_search(VALUE vself){
 }
 
 
-static VALUE tdbqry_searchout(VALUE vself){
-  VALUE vqry;
-  TDBQRY *qry;
-  vqry = rb_iv_get(vself, TDBQRYVNDATA);
-  Data_Get_Struct(vqry, TDBQRY, qry);
-  return tctdbqrysearchout(qry) ? Qtrue : Qfalse;
+static void *tdbqry_fetchrows(TDBROWS *rows){
+  const char *pkbuf;
+  int i, num, pksiz;
+  num = tclistnum(rows->pkeys);
+  for(i = 0; i < num; i++){
+    pkbuf = tclistval(rows->pkeys, i, &pksiz);
+    rows->rows[i] = tctdbget(rows->tdb, pkbuf, pksiz);
+  }
+  return NULL;
 }
 
 
-static VALUE tdbqry_proc(VALUE vself, VALUE vproc){
-  VALUE vqry;
-  TDBQRY *qry;
-  if(rb_block_given_p() != Qtrue) rb_raise(rb_eArgError, "no block given");
-  vqry = rb_iv_get(vself, TDBQRYVNDATA);
-  Data_Get_Struct(vqry, TDBQRY, qry);
-  return tctdbqryproc(qry, (TDBQRYPROC)tdbqry_procrec, NULL) ? Qtrue : Qfalse;
+static TDBIDX *tdbqry_coveridx(TCTDB *tdb, const char *name){
+  TDBIDX *idx;
+  int i;
+  for(i = 0; i < tdb->inum; i++){
+    idx = tdb->idxs + i;
+    if(!strcmp(idx->name, name) && (idx->type == TDBITLEXICAL || idx->type == TDBITDECIMAL))
+      return idx;
+  }
+  return NULL;
 }
 
 
-static VALUE tdbqry_hint(VALUE vself){
-  VALUE vqry;
-  TDBQRY *qry;
-  vqry = rb_iv_get(vself, TDBQRYVNDATA);
-  Data_Get_Struct(vqry, TDBQRY, qry);
-  return rb_str_new2(tctdbqryhint(qry));
+static void tdbqry_coverbound(TDBQRYCOVCOL *col, int op, const char *expr){
+  double lower, upper, swap;
+  char *ep;
+  lower = -HUGE_VAL;
+  upper = HUGE_VAL;
+  switch(op){
+  case TDBQCSTREQ:
+  case TDBQCSTRBW:
+    if(!col->prefix){
+      col->prefix = tcstrdup(expr);
+      col->exact = op == TDBQCSTREQ;
+    }
+    return;
+  case TDBQCNUMEQ:
+    lower = upper = tcatof(expr);
+    break;
+  case TDBQCNUMGT:
+  case TDBQCNUMGE:
+    lower = tcatof(expr);
+    break;
+  case TDBQCNUMLT:
+  case TDBQCNUMLE:
+    upper = tcatof(expr);
+    break;
+  case TDBQCNUMBT:
+    lower = strtod(expr, &ep);
+    while(*ep == ' ' || *ep == ',' || *ep == '\t') ep++;
+    upper = strtod(ep, NULL);
+    if(lower > upper){
+      swap = lower;
+      lower = upper;
+      upper = swap;
+    }
+    break;
+  default:
+    return;
+  }
+  if(lower > col->lower) col->lower = lower;
+  if(upper < col->upper) col->upper = upper;
+}
+
+
+static TDBQRYCOVCOL *tdbqry_covercols(VALUE vtpl, VALUE vnames){
+  VALUE vent, vexpr;
+  TDBQRYCOVCOL *cols, *col;
+  int i, j, num, tnum, op;
+  num = RARRAY_LEN(vnames);
+  for(i = 0; i < num; i++){
+    if(TYPE(rb_ary_entry(vnames, i)) != T_STRING) return NULL;
+  }
+  cols = tcmalloc(sizeof(*cols) * num + 1);
+  tnum = RARRAY_LEN(vtpl);
+  for(i = 0; i < num; i++){
+    col = cols + i;
+    col->name = tcstrdup(RSTRING_PTR(rb_ary_entry(vnames, i)));
+    col->prefix = NULL;
+    col->exact = false;
+    col->lower = -HUGE_VAL;
+    col->upper = HUGE_VAL;
+    if(col->name[0] == '\0') continue;
+    for(j = 0; j < tnum; j++){
+      vent = rb_ary_entry(vtpl, j);
+      if(FIX2INT(rb_ary_entry(vent, 0)) != TDBQRYTCOND) continue;
+      vexpr = rb_ary_entry(vent, 3);
+      if(SYMBOL_P(vexpr) || strcmp(RSTRING_PTR(rb_ary_entry(vent, 1)), col->name)) continue;
+      op = NUM2INT(rb_ary_entry(vent, 2));
+      if(op & TDBQCNEGATE) continue;
+      tdbqry_coverbound(col, op & ~TDBQCNOIDX, RSTRING_PTR(vexpr));
+    }
+  }
+  return cols;
+}
+
+
+static void *tdbqry_coverscan(TDBQRYCOVER *cov){
+  TCTDB *tdb;
+  TDBQRYCOVCOL *col;
+  TDBIDX *idx;
+  BDBCUR *cur;
+  TCMAP *slots;
+  const char *pkbuf, *sep, *ibuf;
+  char *kbuf, nbuf[NUMBUFSIZ];
+  int i, j, rnum, hnum, found, scnt, smax, pksiz, ksiz, vsiz, isiz, plen;
+  bool num, ok;
+  tdb = cov->tdb;
+  if(tdb->mmtx) pthread_rwlock_rdlock(tdb->mmtx);
+  if(!tdb->open){
+    if(tdb->mmtx) pthread_rwlock_unlock(tdb->mmtx);
+    cov->miss = true;
+    return NULL;
+  }
+  rnum = tclistnum(cov->pkeys);
+  slots = tcmapnew2(rnum + 1);
+  for(i = 0; i < rnum; i++){
+    pkbuf = tclistval(cov->pkeys, i, &pksiz);
+    if(tchdbvsiz(tdb->hdb, pkbuf, pksiz) < 0) continue;
+    cov->rows[i] = tcmapnew2(cov->cnum + 1);
+    tcmapput(slots, pkbuf, pksiz, &i, sizeof(i));
+  }
+  hnum = tcmaprnum(slots);
+  smax = hnum * COVERSCANMUL + COVERSCANMIN;
+  for(i = 0; i < cov->cnum && !cov->miss; i++){
+    col = cov->cols + i;
+    if(col->name[0] == '\0') continue;
+    idx = tdbqry_coveridx(tdb, col->name);
+    num = idx && idx->type == TDBITDECIMAL;
+    if(!idx || (num ? col->lower == -HUGE_VAL && col->upper == HUGE_VAL : !col->prefix)){
+      cov->miss = true;
+      break;
+    }
+    cur = tcbdbcurnew(idx->db);
+    plen = (!num && col->prefix) ? strlen(col->prefix) : 0;
+    if(num && col->lower > -1e18 && col->lower < 1e18){
+      sprintf(nbuf, "%lld", (long long)floor(col->lower));
+      ok = tcbdbcurjump(cur, nbuf, strlen(nbuf));
+    } else if(!num && col->prefix){
+      ok = tcbdbcurjump(cur, col->prefix, plen);
+    } else {
+      ok = tcbdbcurfirst(cur);
+    }
+    found = 0;
+    scnt = 0;
+    while(ok && found < hnum && (kbuf = tcbdbcurkey(cur, &ksiz)) != NULL){
+      sep = memchr(kbuf, '\0', ksiz);
+      vsiz = sep ? sep - kbuf : ksiz;
+      if(++scnt > smax){
+        cov->miss = true;
+        ok = false;
+      } else if(num && tcatof(kbuf) > col->upper){
+        ok = false;
+      } else if(!num && col->prefix && (vsiz < plen || memcmp(kbuf, col->prefix, plen) ||
+                                        (col->exact && vsiz != plen))){
+        ok = false;
+      } else if(sep && (!num || tcatof(kbuf) >= col->lower) &&
+                (ibuf = tcmapget(slots, sep + 1, ksiz - vsiz - 1, &isiz)) != NULL){
+        memcpy(&j, ibuf, sizeof(j));
+        tcmapput(cov->rows[j], col->name, strlen(col->name), kbuf, vsiz);
+        found++;
+      }
+      tcfree(kbuf);
+      if(ok) ok = tcbdbcurnext(cur);
+    }
+    tcbdbcurdel(cur);
+  }
+  if(tdb->mmtx) pthread_rwlock_unlock(tdb->mmtx);
+  tcmapdel(slots);
+  return NULL;
+}
+
+
+static VALUE tdbqry_rowsrun(VALUE vrows){
+  TDBROWS *rows;
+  VALUE vary;
+  const char *pkbuf;
+  int i, num, pksiz;
+  rows = (TDBROWS *)vrows;
+  num = tclistnum(rows->pkeys);
+  if(rows->cov){
+    NOGVLCALL(tdbqry_coverscan, rows->cov);
+    if(rows->cov->miss){
+      for(i = 0; i < num; i++){
+        if(rows->rows[i]) tcmapdel(rows->rows[i]);
+        rows->rows[i] = NULL;
+      }
+      NOGVLCALL(tdbqry_fetchrows, rows);
+    }
+  } else {
+    NOGVLCALL(tdbqry_fetchrows, rows);
+  }
+  vary = rb_ary_new2(num);
+  for(i = 0; i < num; i++){
+    if(!rows->rows[i]) continue;
+    pkbuf = tclistval(rows->pkeys, i, &pksiz);
+    rb_ary_push(vary, rb_ary_new3(2, rb_str_new(pkbuf, pksiz),
+                                  tdbdecode(rows->vtdb, rows->rows[i], rows->vnames)));
+    tcmapdel(rows->rows[i]);
+    rows->rows[i] = NULL;
+  }
+  return vary;
+}
+
+
+static VALUE tdbqry_rowsfree(VALUE vrows){
+  TDBROWS *rows;
+  int i, num;
+  rows = (TDBROWS *)vrows;
+  num = tclistnum(rows->pkeys);
+  for(i = 0; i < num; i++){
+    if(rows->rows[i]) tcmapdel(rows->rows[i]);
+  }
+  tcfree(rows->rows);
+  tclistdel(rows->pkeys);
+  if(rows->cov){
+    for(i = 0; i < rows->cov->cnum; i++){
+      tcfree(rows->cov->cols[i].prefix);
+      tcfree(rows->cov->cols[i].name);
+    }
+    tcfree(rows->cov->cols);
+  }
+  return Qnil;
+}
+
+
+static VALUE tdbqry_searchrows(int argc, VALUE *argv, VALUE vself){
+  VALUE vtdb, vnames;
+  TDBQRY *qry;
+  TDBROWS rows;
+  TDBQRYCOVER cov;
+  int num;
+  rb_scan_args(argc, argv, "01", &vnames);
+  if(vnames != Qnil) Check_Type(vnames, T_ARRAY);
+  qry = tdbqry_native(vself);
+  vtdb = rb_iv_get(vself, TDBVNDATA);
+  Data_Get_Struct(vtdb, TCTDB, rows.tdb);
+  cov.cols = (vnames != Qnil) ? tdbqry_covercols(rb_iv_get(vself, TDBQRYVNTPL), vnames) : NULL;
+  rows.pkeys = tctdbqrysearch(qry);
+  num = tclistnum(rows.pkeys);
+  rows.rows = tccalloc(num + 1, sizeof(*rows.rows));
+  rows.vtdb = vtdb;
+  rows.vnames = vnames;
+  rows.cov = NULL;
+  if(cov.cols){
+    cov.tdb = rows.tdb;
+    cov.cnum = RARRAY_LEN(vnames);
+    cov.miss = false;
+    cov.pkeys = rows.pkeys;
+    cov.rows = rows.rows;
+    rows.cov = &cov;
+  }
+  return rb_ensure(tdbqry_rowsrun, (VALUE)&rows, tdbqry_rowsfree, (VALUE)&rows);
+}
+
+
+static VALUE tdbqry_searchout(VALUE vself){
+  TDBQRY *qry;
+  qry = tdbqry_native(vself);
+  return tctdbqrysearchout(qry) ? Qtrue : Qfalse;
+}
+
+
+static VALUE tdbqry_proc(int argc, VALUE *argv, VALUE vself){
+  VALUE vlazy;
+  TDBQRY *qry;
+  TDBQRYPROCOP op;
+  rb_scan_args(argc, argv, "01", &vlazy);
+  if(rb_block_given_p() != Qtrue) rb_raise(rb_eArgError, "no block given");
+  qry = tdbqry_native(vself);
+  if(!RTEST(vlazy)) return tctdbqryproc(qry, (TDBQRYPROC)tdbqry_procrec, NULL) ? Qtrue : Qfalse;
+  op.qry = qry;
+  op.row = tcmalloc(sizeof(*op.row));
+  op.row->cols = NULL;
+  op.row->dirty = false;
+  op.vrow = rb_obj_alloc(cls_tdbrow);
+  rb_iv_set(op.vrow, TDBROWVNDATA, Data_Wrap_Struct(cls_tdbrow_data, 0, tcfree, op.row));
+  return rb_ensure(tdbqry_procrun, (VALUE)&op, tdbqry_procend, (VALUE)&op);
+}
+
+
+static VALUE tdbqry_hint(VALUE vself){
+  VALUE vqry;
+  TDBQRY *qry;
+  vqry = rb_iv_get(vself, TDBQRYVNDATA);
+  Data_Get_Struct(vqry, TDBQRY, qry);
+  return rb_str_new2(tctdbqryhint(qry));
+}
+
+
+static TDBQRY *tdbqry_native(VALUE vself){
+  VALUE vqry, vtpl, vent;
+  TDBQRY *qry;
+  int i, num;
+  vtpl = rb_iv_get(vself, TDBQRYVNTPL);
+  num = RARRAY_LEN(vtpl);
+  for(i = 0; i < num; i++){
+    vent = rb_ary_entry(vtpl, i);
+    if(FIX2INT(rb_ary_entry(vent, 0)) == TDBQRYTCOND && SYMBOL_P(rb_ary_entry(vent, 3)))
+      rb_raise(rb_eArgError, "unbound placeholder");
+  }
+  vqry = rb_iv_get(vself, TDBQRYVNDATA);
+  Data_Get_Struct(vqry, TDBQRY, qry);
+  return qry;
+}
+
+
+static TDBQRY *tdbqry_build(TCTDB *tdb, VALUE vtpl, VALUE vbinds){
+  VALUE vexprs, vent, vexpr;
+  TDBQRY *qry;
+  int i, num;
+  if(vbinds != Qnil) Check_Type(vbinds, T_HASH);
+  num = RARRAY_LEN(vtpl);
+  vexprs = rb_ary_new2(num);
+  for(i = 0; i < num; i++){
+    vent = rb_ary_entry(vtpl, i);
+    if(FIX2INT(rb_ary_entry(vent, 0)) != TDBQRYTCOND) continue;
+    vexpr = rb_ary_entry(vent, 3);
+    if(SYMBOL_P(vexpr)){
+      if(vbinds == Qnil || (vexpr = rb_hash_aref(vbinds, vexpr)) == Qnil)
+        rb_raise(rb_eArgError, "unbound placeholder");
+      vexpr = StringValueEx(vexpr);
+    }
+    rb_ary_store(vexprs, i, vexpr);
+  }
+  qry = tctdbqrynew(tdb);
+  for(i = 0; i < num; i++){
+    vent = rb_ary_entry(vtpl, i);
+    switch(FIX2INT(rb_ary_entry(vent, 0))){
+    case TDBQRYTCOND:
+      tctdbqryaddcond(qry, RSTRING_PTR(rb_ary_entry(vent, 1)), NUM2INT(rb_ary_entry(vent, 2)),
+                      RSTRING_PTR(rb_ary_entry(vexprs, i)));
+      break;
+    case TDBQRYTORDER:
+      tctdbqrysetorder(qry, RSTRING_PTR(rb_ary_entry(vent, 1)), NUM2INT(rb_ary_entry(vent, 2)));
+      break;
+    case TDBQRYTLIMIT:
+      tctdbqrysetlimit(qry, NUM2INT(rb_ary_entry(vent, 1)), NUM2INT(rb_ary_entry(vent, 2)));
+      break;
+    }
+  }
+  return qry;
+}
+
+
+static VALUE tdbqry_execute(int argc, VALUE *argv, VALUE vself){
+  VALUE vtdb, vbinds, vary;
+  TCTDB *tdb;
+  TDBQRY *qry;
+  TCLIST *res;
+  rb_scan_args(argc, argv, "01", &vbinds);
+  vtdb = rb_iv_get(vself, TDBVNDATA);
+  Data_Get_Struct(vtdb, TCTDB, tdb);
+  qry = tdbqry_build(tdb, rb_iv_get(vself, TDBQRYVNTPL), vbinds);
+  res = tctdbqrysearch(qry);
+  vary = listtovary(res);
+  tclistdel(res);
+  tctdbqrydel(qry);
+  return vary;
+}
+
+
+static VALUE tdbqry_metasearch(int argc, VALUE *argv, VALUE vself){
+  VALUE vothers, vtype, vother, vary;
+  TDBQRY *qry, **qrys;
+  TCLIST *res;
+  int i, num, type;
+  rb_scan_args(argc, argv, "11", &vothers, &vtype);
+  Check_Type(vothers, T_ARRAY);
+  type = (vtype == Qnil) ? TDBMSUNION : NUM2INT(vtype);
+  num = RARRAY_LEN(vothers);
+  qry = tdbqry_native(vself);
+  for(i = 0; i < num; i++){
+    vother = rb_ary_entry(vothers, i);
+    if(rb_obj_is_kind_of(vother, cls_tdbqry) != Qtrue)
+      rb_raise(rb_eArgError, "not a query object");
+    if(tdbqry_native(vother)->tdb != qry->tdb)
+      rb_raise(rb_eArgError, "query of another database");
+  }
+  qrys = tcmalloc(sizeof(*qrys) * (num + 1));
+  qrys[0] = qry;
+  for(i = 0; i < num; i++){
+    qrys[i+1] = tdbqry_native(rb_ary_entry(vothers, i));
+  }
+  res = tctdbmetasearch(qrys, num + 1, type);
+  tcfree(qrys);
+  vary = listtovary(res);
+  tclistdel(res);
+  return vary;
+}
+
+
+static VALUE tdbqry_count(VALUE vself){
+  VALUE vtdb;
+  TCTDB *tdb;
+  TDBQRY *qry;
+  TCLIST *res;
+  int num;
+  vtdb = rb_iv_get(vself, TDBVNDATA);
+  Data_Get_Struct(vtdb, TCTDB, tdb);
+  qry = tdbqry_build(tdb, rb_iv_get(vself, TDBQRYVNTPL), Qnil);
+  res = NOGVLCALL(tctdbqrysearch, qry);
+  tctdbqrydel(qry);
+  num = tclistnum(res);
+  tclistdel(res);
+  return INT2NUM(num);
+}
+
+
+static VALUE tdbqry_exists(VALUE vself){
+  VALUE vtdb;
+  TCTDB *tdb;
+  TDBQRY *qry;
+  TCLIST *res;
+  int num;
+  vtdb = rb_iv_get(vself, TDBVNDATA);
+  Data_Get_Struct(vtdb, TCTDB, tdb);
+  qry = tdbqry_build(tdb, rb_iv_get(vself, TDBQRYVNTPL), Qnil);
+  tcfree(qry->oname);
+  qry->oname = NULL;
+  tctdbqrysetlimit(qry, 1, 0);
+  res = NOGVLCALL(tctdbqrysearch, qry);
+  tctdbqrydel(qry);
+  num = tclistnum(res);
+  tclistdel(res);
+  return num > 0 ? Qtrue : Qfalse;
+}
+
+
+static void *tdbqry_aggscan(TDBQRYAGG *agg){
+  TDBQRYACC *accs, *acc;
+  TCLIST *res;
+  TCMAP *cols;
+  const char *pkbuf, *gbuf, *vbuf;
+  int i, j, rnum, pksiz, gsiz, vsiz, asiz;
+  double num;
+  asiz = sizeof(*accs) * agg->anum;
+  accs = tcmalloc(asiz + 1);
+  res = tctdbqrysearch(agg->qry);
+  rnum = tclistnum(res);
+  for(i = 0; i < rnum; i++){
+    pkbuf = tclistval(res, i, &pksiz);
+    if(!(cols = tctdbget(agg->qry->tdb, pkbuf, pksiz))) continue;
+    gbuf = agg->gname ? tcmapget(cols, agg->gname, strlen(agg->gname), &gsiz) : NULL;
+    if(!gbuf){
+      gbuf = "";
+      gsiz = 0;
+    }
+    if((vbuf = tcmapget(agg->groups, gbuf, gsiz, &vsiz)) != NULL){
+      memcpy(accs, vbuf, asiz);
+    } else {
+      memset(accs, 0, asiz);
+    }
+    for(j = 0; j < agg->anum; j++){
+      acc = accs + j;
+      if(agg->names[j][0] == '\0'){
+        acc->cnt++;
+        continue;
+      }
+      if(!(vbuf = tcmapget2(cols, agg->names[j]))) continue;
+      num = tcatof(vbuf);
+      if(acc->cnt < 1 || num < acc->min) acc->min = num;
+      if(acc->cnt < 1 || num > acc->max) acc->max = num;
+      acc->sum += num;
+      acc->cnt++;
+    }
+    tcmapput(agg->groups, gbuf, gsiz, accs, asiz);
+    tcmapdel(cols);
+  }
+  tclistdel(res);
+  tcfree(accs);
+  return NULL;
+}
+
+
+static VALUE tdbqry_aggregate(VALUE vself, VALUE vgname, VALUE vspecs){
+  VALUE vtdb, vspec, vname, vhash, vvals, vval;
+  TCTDB *tdb;
+  TDBQRYAGG agg;
+  const TDBQRYACC *accs, *acc;
+  const char *kbuf;
+  int i, ksiz, vsiz, *ops;
+  Check_Type(vspecs, T_ARRAY);
+  if(vgname != Qnil) vgname = StringValueEx(vgname);
+  agg.anum = RARRAY_LEN(vspecs);
+  vspecs = rb_ary_dup(vspecs);
+  for(i = 0; i < agg.anum; i++){
+    vspec = rb_ary_entry(vspecs, i);
+    Check_Type(vspec, T_ARRAY);
+    if(NUM2INT(rb_ary_entry(vspec, 0)) < TDBQRYAGGCOUNT ||
+       NUM2INT(rb_ary_entry(vspec, 0)) > TDBQRYAGGAVG)
+      rb_raise(rb_eArgError, "invalid aggregation type");
+    vname = rb_ary_entry(vspec, 1);
+    vname = (vname != Qnil) ? StringValueEx(vname) : rb_str_new2("");
+    rb_ary_store(vspecs, i, rb_ary_new3(2, rb_ary_entry(vspec, 0), vname));
+  }
+  vtdb = rb_iv_get(vself, TDBVNDATA);
+  Data_Get_Struct(vtdb, TCTDB, tdb);
+  agg.qry = tdbqry_build(tdb, rb_iv_get(vself, TDBQRYVNTPL), Qnil);
+  agg.gname = (vgname != Qnil) ? tcstrdup(RSTRING_PTR(vgname)) : NULL;
+  agg.names = tcmalloc(sizeof(*agg.names) * agg.anum + 1);
+  ops = tcmalloc(sizeof(*ops) * agg.anum + 1);
+  for(i = 0; i < agg.anum; i++){
+    vspec = rb_ary_entry(vspecs, i);
+    ops[i] = NUM2INT(rb_ary_entry(vspec, 0));
+    agg.names[i] = tcstrdup(RSTRING_PTR(rb_ary_entry(vspec, 1)));
+  }
+  agg.groups = tcmapnew();
+  NOGVLCALL(tdbqry_aggscan, &agg);
+  tctdbqrydel(agg.qry);
+  for(i = 0; i < agg.anum; i++){
+    tcfree((char *)agg.names[i]);
+  }
+  tcfree(agg.names);
+  vhash = rb_hash_new();
+  tcmapiterinit(agg.groups);
+  while((kbuf = tcmapiternext(agg.groups, &ksiz)) != NULL){
+    accs = tcmapiterval(kbuf, &vsiz);
+    vvals = rb_ary_new2(agg.anum);
+    for(i = 0; i < agg.anum; i++){
+      acc = accs + i;
+      switch(ops[i]){
+      case TDBQRYAGGCOUNT:
+        vval = LL2NUM(acc->cnt);
+        break;
+      case TDBQRYAGGSUM:
+        vval = rb_float_new(acc->sum);
+        break;
+      case TDBQRYAGGMIN:
+        vval = (acc->cnt > 0) ? rb_float_new(acc->min) : Qnil;
+        break;
+      case TDBQRYAGGMAX:
+        vval = (acc->cnt > 0) ? rb_float_new(acc->max) : Qnil;
+        break;
+      default:
+        vval = (acc->cnt > 0) ? rb_float_new(acc->sum / acc->cnt) : Qnil;
+        break;
+      }
+      rb_ary_push(vvals, vval);
+    }
+    rb_hash_aset(vhash, agg.gname ? rb_str_new(kbuf, ksiz) : Qnil, vvals);
+  }
+  tcmapdel(agg.groups);
+  tcfree(ops);
+  tcfree((char *)agg.gname);
+  return vhash;
+}
+
+
+static VALUE tdbqry_procrun(VALUE vproc){
+  TDBQRYPROCOP *op;
+  op = (TDBQRYPROCOP *)vproc;
+  return tctdbqryproc(op->qry, (TDBQRYPROC)tdbqry_procrec, op) ? Qtrue : Qfalse;
+}
+
+
+static VALUE tdbqry_procend(VALUE vproc){
+  TDBQRYPROCOP *op;
+  op = (TDBQRYPROCOP *)vproc;
+  op->row->cols = NULL;
+  return Qnil;
+}
+
+
+static int tdbqry_updrec(const void *pkbuf, int pksiz, TCMAP *cols, TDBQRYUPD *upd){
+  const char *vbuf;
+  char nbuf[NUMBUFSIZ];
+  int64_t inum, iadd;
+  int i, nsiz;
+  for(i = 0; i < upd->unum; i++){
+    switch(upd->ops[i]){
+    case TDBQRYUSET:
+      tcmapput2(cols, upd->names[i], upd->vals[i]);
+      break;
+    case TDBQRYUADD:
+      vbuf = tcmapget2(cols, upd->names[i]);
+      if(upd->reals[i]){
+        nsiz = sprintf(nbuf, "%.17g", (vbuf ? tcatof(vbuf) : 0.0) + tcatof(upd->vals[i]));
+      } else {
+        inum = vbuf ? tcatoi(vbuf) : 0;
+        iadd = tcatoi(upd->vals[i]);
+        if((iadd > 0 && inum > INT64_MAX - iadd) || (iadd < 0 && inum < INT64_MIN - iadd)){
+          upd->err = true;
+          return TDBQPSTOP;
+        }
+        nsiz = sprintf(nbuf, "%lld", (long long)(inum + iadd));
+      }
+      tcmapput(cols, upd->names[i], strlen(upd->names[i]), nbuf, nsiz);
+      break;
+    case TDBQRYUCAT:
+      tcmapputcat(cols, upd->names[i], strlen(upd->names[i]), upd->vals[i], strlen(upd->vals[i]));
+      break;
+    default:
+      tcmapout(cols, upd->names[i], strlen(upd->names[i]));
+      break;
+    }
+  }
+  upd->cnt++;
+  return TDBQPPUT;
+}
+
+
+static void *tdbqry_updrun(TDBQRYUPD *upd){
+  TCTDB *tdb;
+  bool tran;
+  tdb = upd->qry->tdb;
+  tran = upd->tran;
+  if(tran && !tctdbtranbegin(tdb)){
+    upd->err = true;
+    return NULL;
+  }
+  if(!tctdbqryproc(upd->qry, (TDBQRYPROC)tdbqry_updrec, upd) || upd->err){
+    upd->err = true;
+    if(tran) tctdbtranabort(tdb);
+  } else if(tran && !tctdbtrancommit(tdb)){
+    upd->err = true;
+  }
+  return NULL;
+}
+
+
+static VALUE tdbqry_update(VALUE vself, VALUE vexprs){
+  VALUE vtdb, vexpr, vname, vval;
+  TCTDB *tdb;
+  TDBQRYUPD upd;
+  int i, op;
+  bool real;
+  Check_Type(vexprs, T_ARRAY);
+  upd.unum = RARRAY_LEN(vexprs);
+  if(upd.unum < 1) return INT2FIX(0);
+  vexprs = rb_ary_dup(vexprs);
+  for(i = 0; i < upd.unum; i++){
+    vexpr = rb_ary_entry(vexprs, i);
+    Check_Type(vexpr, T_ARRAY);
+    op = NUM2INT(rb_ary_entry(vexpr, 0));
+    if(op < TDBQRYUSET || op > TDBQRYUDEL) rb_raise(rb_eArgError, "invalid update type");
+    vname = StringValueEx(rb_ary_entry(vexpr, 1));
+    vval = rb_ary_entry(vexpr, 2);
+    real = op == TDBQRYUADD && TYPE(vval) == T_FLOAT;
+    if(op == TDBQRYUADD && !real) vval = LL2NUM(NUM2LL(vval));
+    vval = (op == TDBQRYUDEL) ? rb_str_new2("") : StringValueEx(vval);
+    rb_ary_store(vexprs, i, rb_ary_new3(4, INT2FIX(op), vname, vval, real ? Qtrue : Qfalse));
+  }
+  vtdb = rb_iv_get(vself, TDBVNDATA);
+  Data_Get_Struct(vtdb, TCTDB, tdb);
+  upd.qry = tdbqry_build(tdb, rb_iv_get(vself, TDBQRYVNTPL), Qnil);
+  upd.ops = tcmalloc(sizeof(*upd.ops) * upd.unum + 1);
+  upd.names = tcmalloc(sizeof(*upd.names) * upd.unum + 1);
+  upd.vals = tcmalloc(sizeof(*upd.vals) * upd.unum + 1);
+  upd.reals = tcmalloc(sizeof(*upd.reals) * upd.unum + 1);
+  for(i = 0; i < upd.unum; i++){
+    vexpr = rb_ary_entry(vexprs, i);
+    upd.ops[i] = FIX2INT(rb_ary_entry(vexpr, 0));
+    upd.names[i] = tcstrdup(RSTRING_PTR(rb_ary_entry(vexpr, 1)));
+    upd.vals[i] = tcstrdup(RSTRING_PTR(rb_ary_entry(vexpr, 2)));
+    upd.reals[i] = rb_ary_entry(vexpr, 3) == Qtrue;
+  }
+  upd.tran = !tdb->tran || rb_iv_get(vtdb, TDBVNTRAN) != rb_thread_current();
+  upd.cnt = 0;
+  upd.err = false;
+  NOGVLCALL(tdbqry_updrun, &upd);
+  tctdbqrydel(upd.qry);
+  for(i = 0; i < upd.unum; i++){
+    tcfree((char *)upd.vals[i]);
+    tcfree((char *)upd.names[i]);
+  }
+  tcfree(upd.reals);
+  tcfree(upd.vals);
+  tcfree(upd.names);
+  tcfree(upd.ops);
+  return upd.err ? INT2FIX(-1) : LL2NUM(upd.cnt);
+}
+
+
+static void tdbqry_topup(TDBQRYTOPENT *ents, int cur, int otype){
+  TDBQRYTOPENT swap;
+  int parent;
+  while(cur > 0){
+    parent = (cur - 1) / 2;
+    if(tdbordcmp(otype, ents[cur].vbuf, ents[cur].vsiz, ents[parent].vbuf, ents[parent].vsiz) <= 0)
+      break;
+    swap = ents[cur];
+    ents[cur] = ents[parent];
+    ents[parent] = swap;
+    cur = parent;
+  }
+}
+
+
+static void tdbqry_topdown(TDBQRYTOPENT *ents, int num, int cur, int otype){
+  TDBQRYTOPENT swap;
+  int child;
+  while((child = cur * 2 + 1) < num){
+    if(child + 1 < num && tdbordcmp(otype, ents[child+1].vbuf, ents[child+1].vsiz,
+                                    ents[child].vbuf, ents[child].vsiz) > 0) child++;
+    if(tdbordcmp(otype, ents[child].vbuf, ents[child].vsiz, ents[cur].vbuf, ents[cur].vsiz) <= 0)
+      break;
+    swap = ents[cur];
+    ents[cur] = ents[child];
+    ents[child] = swap;
+    cur = child;
+  }
+}
+
+
+static void *tdbqry_toprun(TDBQRYTOP *top){
+  TDBQRY *qry;
+  TDBQRYTOPENT *ents, swap;
+  TCLIST *res;
+  TCMAP *cols;
+  const char *pkbuf, *vbuf;
+  int i, num, hnum, pksiz, vsiz;
+  qry = top->qry;
+  if(top->indexed){
+    top->res = tctdbqrysearch(qry);
+  } else {
+    res = tctdbqrysearch(qry);
+    num = tclistnum(res);
+    ents = tcmalloc(sizeof(*ents) * (num < top->k ? num : top->k) + 1);
+    hnum = 0;
+    for(i = 0; i < num; i++){
+      pkbuf = tclistval(res, i, &pksiz);
+      cols = NULL;
+      if(top->oname[0] == '\0'){
+        vbuf = pkbuf;
+        vsiz = pksiz;
+      } else if((cols = tctdbget(qry->tdb, pkbuf, pksiz)) != NULL &&
+                (vbuf = tcmapget2(cols, top->oname)) != NULL){
+        vsiz = strlen(vbuf);
+      } else {
+        vbuf = "";
+        vsiz = 0;
+      }
+      if(hnum < top->k){
+        ents[hnum].idx = i;
+        ents[hnum].vbuf = tcmemdup(vbuf, vsiz);
+        ents[hnum].vsiz = vsiz;
+        tdbqry_topup(ents, hnum++, top->otype);
+      } else if(tdbordcmp(top->otype, vbuf, vsiz, ents[0].vbuf, ents[0].vsiz) < 0){
+        tcfree(ents[0].vbuf);
+        ents[0].idx = i;
+        ents[0].vbuf = tcmemdup(vbuf, vsiz);
+        ents[0].vsiz = vsiz;
+        tdbqry_topdown(ents, hnum, 0, top->otype);
+      }
+      if(cols) tcmapdel(cols);
+    }
+    for(i = hnum - 1; i > 0; i--){
+      swap = ents[0];
+      ents[0] = ents[i];
+      ents[i] = swap;
+      tdbqry_topdown(ents, i, 0, top->otype);
+    }
+    top->res = tclistnew2(hnum);
+    for(i = 0; i < hnum; i++){
+      pkbuf = tclistval(res, ents[i].idx, &pksiz);
+      tclistpush(top->res, pkbuf, pksiz);
+      tcfree(ents[i].vbuf);
+    }
+    tcfree(ents);
+    tclistdel(res);
+  }
+  return NULL;
+}
+
+
+static VALUE tdbqry_top(VALUE vself, VALUE vk, VALUE vname, VALUE vtype){
+  VALUE vtdb, vary;
+  TCTDB *tdb;
+  TDBQRYTOP top;
+  TDBIDX *idx;
+  int i;
+  vname = StringValueEx(vname);
+  top.k = NUM2INT(vk);
+  top.otype = NUM2INT(vtype);
+  vtdb = rb_iv_get(vself, TDBVNDATA);
+  Data_Get_Struct(vtdb, TCTDB, tdb);
+  top.qry = tdbqry_build(tdb, rb_iv_get(vself, TDBQRYVNTPL), Qnil);
+  if(top.k < 1){
+    tctdbqrydel(top.qry);
+    return rb_ary_new();
+  }
+  top.oname = tcstrdup(RSTRING_PTR(vname));
+  top.indexed = false;
+  if(tdb->mmtx) pthread_rwlock_rdlock(tdb->mmtx);
+  for(i = 0; i < tdb->inum; i++){
+    idx = tdb->idxs + i;
+    if(strcmp(idx->name, top.oname)) continue;
+    if(idx->type == TDBITLEXICAL && (top.otype == TDBQOSTRASC || top.otype == TDBQOSTRDESC))
+      top.indexed = true;
+    if(idx->type == TDBITDECIMAL && (top.otype == TDBQONUMASC || top.otype == TDBQONUMDESC))
+      top.indexed = true;
+  }
+  if(tdb->mmtx) pthread_rwlock_unlock(tdb->mmtx);
+  if(top.indexed){
+    tctdbqrysetorder(top.qry, top.oname, top.otype);
+    tctdbqrysetlimit(top.qry, top.k, 0);
+  } else {
+    tcfree(top.qry->oname);
+    top.qry->oname = NULL;
+    tctdbqrysetlimit(top.qry, -1, 0);
+  }
+  NOGVLCALL(tdbqry_toprun, &top);
+  tctdbqrydel(top.qry);
+  tcfree((char *)top.oname);
+  vary = listtovary(top.res);
+  tclistdel(top.res);
+  return vary;
+}
+
+
+static void tdbrow_init(void){
+  cls_tdbrow = rb_define_class_under(mod_tokyocabinet, "TDBROW", rb_cObject);
+  cls_tdbrow_data = rb_define_class_under(mod_tokyocabinet, "TDBROW_data", rb_cObject);
+  rb_undef_method(CLASS_OF(cls_tdbrow), "new");
+  rb_define_method(cls_tdbrow, "[]", tdbrow_get, 1);
+  rb_define_method(cls_tdbrow, "[]=", tdbrow_put, 2);
+  rb_define_method(cls_tdbrow, "delete", tdbrow_out, 1);
+  rb_define_method(cls_tdbrow, "to_hash", tdbrow_to_hash, 0);
+  rb_define_method(cls_tdbrow, "changed?", tdbrow_changed, 0);
+}
+
+
+static TDBROW *tdbrow_current(VALUE vself){
+  VALUE vrow;
+  TDBROW *row;
+  vrow = rb_iv_get(vself, TDBROWVNDATA);
+  Data_Get_Struct(vrow, TDBROW, row);
+  if(!row->cols) rb_raise(rb_eArgError, "row is not being processed");
+  return row;
+}
+
+
+static VALUE tdbrow_get(VALUE vself, VALUE vname){
+  TDBROW *row;
+  const char *vbuf;
+  int vsiz;
+  vname = StringValueEx(vname);
+  row = tdbrow_current(vself);
+  vbuf = tcmapget(row->cols, RSTRING_PTR(vname), RSTRING_LEN(vname), &vsiz);
+  return vbuf ? rb_str_new(vbuf, vsiz) : Qnil;
+}
+
+
+static VALUE tdbrow_put(VALUE vself, VALUE vname, VALUE vval){
+  TDBROW *row;
+  VALUE vstr;
+  const char *vbuf;
+  int vsiz;
+  vname = StringValueEx(vname);
+  if(vval == Qnil){
+    tdbrow_out(vself, vname);
+    return Qnil;
+  }
+  vstr = StringValueEx(vval);
+  row = tdbrow_current(vself);
+  vbuf = tcmapget(row->cols, RSTRING_PTR(vname), RSTRING_LEN(vname), &vsiz);
+  if(!vbuf || vsiz != RSTRING_LEN(vstr) || memcmp(vbuf, RSTRING_PTR(vstr), vsiz)){
+    tcmapput(row->cols, RSTRING_PTR(vname), RSTRING_LEN(vname),
+             RSTRING_PTR(vstr), RSTRING_LEN(vstr));
+    row->dirty = true;
+  }
+  return vval;
+}
+
+
+static VALUE tdbrow_out(VALUE vself, VALUE vname){
+  TDBROW *row;
+  vname = StringValueEx(vname);
+  row = tdbrow_current(vself);
+  if(!tcmapout(row->cols, RSTRING_PTR(vname), RSTRING_LEN(vname))) return Qfalse;
+  row->dirty = true;
+  return Qtrue;
+}
+
+
+static VALUE tdbrow_to_hash(VALUE vself){
+  return maptovhash(tdbrow_current(vself)->cols);
+}
+
+
+static VALUE tdbrow_changed(VALUE vself){
+  return tdbrow_current(vself)->dirty ? Qtrue : Qfalse;
+}
+
+
+
+static void tdbshard_init(void){
+  cls_tdbshard = rb_define_class_under(mod_tokyocabinet, "TDBSHARD", rb_cObject);
+  rb_define_private_method(cls_tdbshard, "initialize", tdbshard_initialize, 1);
+  rb_define_method(cls_tdbshard, "shard", tdbshard_shard, 1);
+  rb_define_method(cls_tdbshard, "put", tdbshard_put, 2);
+  rb_define_method(cls_tdbshard, "out", tdbshard_out, 1);
+  rb_define_method(cls_tdbshard, "get", tdbshard_get, -1);
+  rb_define_method(cls_tdbshard, "rnum", tdbshard_rnum, 0);
+  rb_define_method(cls_tdbshard, "search", tdbshard_search, -1);
+}
+
+
+static uint64_t tdbshard_hash(const char *buf, int size){
+  uint64_t hash;
+  hash = 14695981039346656037ULL;
+  while(size-- > 0){
+    hash ^= *(unsigned char *)buf++;
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
+
+
+static TCTDB *tdbshard_route(VALUE vself, VALUE vpkey){
+  VALUE vtdbs, vtdb;
+  TCTDB *tdb;
+  vtdbs = rb_iv_get(vself, TDBSHARDVNDATA);
+  vtdb = rb_ary_entry(vtdbs, tdbshard_hash(RSTRING_PTR(vpkey), RSTRING_LEN(vpkey)) %
+                      RARRAY_LEN(vtdbs));
+  Data_Get_Struct(vtdb, TCTDB, tdb);
+  return tdb;
+}
+
+
+static VALUE tdbshard_initialize(VALUE vself, VALUE vtdbs){
+  VALUE vary, vtdb;
+  int i, num;
+  Check_Type(vtdbs, T_ARRAY);
+  num = RARRAY_LEN(vtdbs);
+  if(num < 1) rb_raise(rb_eArgError, "no shard");
+  vary = rb_ary_new2(num);
+  for(i = 0; i < num; i++){
+    vtdb = rb_ary_entry(vtdbs, i);
+    Check_Type(vtdb, T_OBJECT);
+    vtdb = rb_iv_get(vtdb, TDBVNDATA);
+    Check_Type(vtdb, T_DATA);
+    rb_ary_push(vary, vtdb);
+  }
+  rb_iv_set(vself, TDBSHARDVNDATA, vary);
+  return Qnil;
+}
+
+
+static VALUE tdbshard_shard(VALUE vself, VALUE vpkey){
+  VALUE vtdbs;
+  vpkey = StringValueEx(vpkey);
+  vtdbs = rb_iv_get(vself, TDBSHARDVNDATA);
+  return INT2NUM(tdbshard_hash(RSTRING_PTR(vpkey), RSTRING_LEN(vpkey)) % RARRAY_LEN(vtdbs));
+}
+
+
+static VALUE tdbshard_put(VALUE vself, VALUE vpkey, VALUE vcols){
+  VALUE vrv;
+  TCTDB *tdb;
+  TCMAP *cols;
+  vpkey = StringValueEx(vpkey);
+  Check_Type(vcols, T_HASH);
+  tdb = tdbshard_route(vself, vpkey);
+  cols = vhashtomap(vcols);
+  vrv = tctdbput(tdb, RSTRING_PTR(vpkey), RSTRING_LEN(vpkey), cols) ? Qtrue : Qfalse;
+  tcmapdel(cols);
+  return vrv;
+}
+
+
+static VALUE tdbshard_out(VALUE vself, VALUE vpkey){
+  TCTDB *tdb;
+  vpkey = StringValueEx(vpkey);
+  tdb = tdbshard_route(vself, vpkey);
+  return tctdbout(tdb, RSTRING_PTR(vpkey), RSTRING_LEN(vpkey)) ? Qtrue : Qfalse;
+}
+
+
+static VALUE tdbshard_get(int argc, VALUE *argv, VALUE vself){
+  VALUE vpkey, vnames, vcols;
+  TCTDB *tdb;
+  TCMAP *cols;
+  rb_scan_args(argc, argv, "11", &vpkey, &vnames);
+  vpkey = StringValueEx(vpkey);
+  if(vnames != Qnil) Check_Type(vnames, T_ARRAY);
+  tdb = tdbshard_route(vself, vpkey);
+  if(!(cols = tctdbget(tdb, RSTRING_PTR(vpkey), RSTRING_LEN(vpkey)))) return Qnil;
+  vcols = maptovhash2(cols, vnames);
+  tcmapdel(cols);
+  return vcols;
+}
+
+
+static VALUE tdbshard_rnum(VALUE vself){
+  VALUE vtdbs, vtdb;
+  TCTDB *tdb;
+  int64_t rnum;
+  int i, num;
+  vtdbs = rb_iv_get(vself, TDBSHARDVNDATA);
+  num = RARRAY_LEN(vtdbs);
+  rnum = 0;
+  for(i = 0; i < num; i++){
+    vtdb = rb_ary_entry(vtdbs, i);
+    Data_Get_Struct(vtdb, TCTDB, tdb);
+    rnum += tctdbrnum(tdb);
+  }
+  return LL2NUM(rnum);
+}
+
+
+static void *tdbshard_scan(TDBSHARDSCAN *scan){
+  TCMAP *cols;
+  const char *pkbuf, *vbuf;
+  int i, num, pksiz;
+  scan->res = tctdbqrysearch(scan->qry);
+  if(!scan->qry->oname) return NULL;
+  num = tclistnum(scan->res);
+  scan->okeys = tclistnew2(num);
+  for(i = 0; i < num; i++){
+    pkbuf = tclistval(scan->res, i, &pksiz);
+    if(scan->qry->oname[0] == '\0'){
+      tclistpush(scan->okeys, pkbuf, pksiz);
+    } else if((cols = tctdbget(scan->qry->tdb, pkbuf, pksiz)) != NULL){
+      vbuf = tcmapget2(cols, scan->qry->oname);
+      tclistpush2(scan->okeys, vbuf ? vbuf : "");
+      tcmapdel(cols);
+    } else {
+      tclistpush2(scan->okeys, "");
+    }
+  }
+  return NULL;
+}
+
+
+static void *tdbshard_scanall(TDBSHARDRUN *run){
+  TDBSHARDSCAN *scan;
+  int i;
+  for(i = 0; i < run->num; i++){
+    scan = run->scans + i;
+    scan->live = false;
+    if(run->num > 1 &&
+       pthread_create(&scan->th, NULL, (void *(*)(void *))tdbshard_scan, scan) == 0){
+      scan->live = true;
+    } else {
+      tdbshard_scan(scan);
+    }
+  }
+  for(i = 0; i < run->num; i++){
+    scan = run->scans + i;
+    if(scan->live) pthread_join(scan->th, NULL);
+    scan->live = false;
+  }
+  return NULL;
+}
+
+
+static int tdbshard_ordcmp(int otype, TDBSHARDSCAN *a, int apos, TDBSHARDSCAN *b, int bpos){
+  const char *abuf, *bbuf;
+  int asiz, bsiz;
+  abuf = tclistval(a->okeys, apos, &asiz);
+  bbuf = tclistval(b->okeys, bpos, &bsiz);
+  return tdbordcmp(otype, abuf, asiz, bbuf, bsiz);
+}
+
+
+static VALUE tdbshard_search(int argc, VALUE *argv, VALUE vself){
+  VALUE vqry, vbinds, vtpl, vtdbs, vtdb, vary;
+  TCTDB *tdb;
+  TDBQRY *qry;
+  TDBSHARDRUN run;
+  TDBSHARDSCAN *scan;
+  const char *pkbuf;
+  int i, num, max, skip, cnt, best, pksiz, *poss;
+  rb_scan_args(argc, argv, "11", &vqry, &vbinds);
+  Check_Type(vqry, T_OBJECT);
+  vtpl = rb_iv_get(vqry, TDBQRYVNTPL);
+  Check_Type(vtpl, T_ARRAY);
+  vtdbs = rb_iv_get(vself, TDBSHARDVNDATA);
+  num = RARRAY_LEN(vtdbs);
+  vtdb = rb_ary_entry(vtdbs, 0);
+  Data_Get_Struct(vtdb, TCTDB, tdb);
+  qry = tdbqry_build(tdb, vtpl, vbinds);
+  max = (qry->max >= 0) ? qry->max : INT_MAX;
+  skip = (qry->skip >= 0) ? qry->skip : 0;
+  run.num = num;
+  run.scans = tccalloc(num, sizeof(*run.scans));
+  run.scans[0].qry = qry;
+  for(i = 1; i < num; i++){
+    vtdb = rb_ary_entry(vtdbs, i);
+    Data_Get_Struct(vtdb, TCTDB, tdb);
+    run.scans[i].qry = tdbqry_build(tdb, vtpl, vbinds);
+  }
+  for(i = 0; i < num; i++){
+    qry = run.scans[i].qry;
+    qry->max = (max < INT_MAX - skip) ? max + skip : INT_MAX;
+    qry->skip = 0;
+  }
+  NOGVLCALL(tdbshard_scanall, &run);
+  poss = tccalloc(num, sizeof(*poss));
+  vary = rb_ary_new();
+  cnt = 0;
+  while(RARRAY_LEN(vary) < max){
+    best = -1;
+    for(i = 0; i < num; i++){
+      scan = run.scans + i;
+      if(poss[i] >= tclistnum(scan->res)) continue;
+      if(best < 0){
+        best = i;
+        if(!scan->okeys) break;
+      } else if(tdbshard_ordcmp(scan->qry->otype, scan, poss[i],
+                                run.scans + best, poss[best]) < 0){
+        best = i;
+      }
+    }
+    if(best < 0) break;
+    scan = run.scans + best;
+    if(cnt++ >= skip){
+      pkbuf = tclistval(scan->res, poss[best], &pksiz);
+      rb_ary_push(vary, rb_str_new(pkbuf, pksiz));
+    }
+    poss[best]++;
+  }
+  tcfree(poss);
+  for(i = 0; i < num; i++){
+    scan = run.scans + i;
+    if(scan->okeys) tclistdel(scan->okeys);
+    tclistdel(scan->res);
+    tctdbqrydel(scan->qry);
+  }
+  tcfree(run.scans);
+  return vary;
 }
 
 